@@ -0,0 +1,173 @@
+#include "bake_cache.h"
+#include "hash.h"
+#include "mapped_file.h"
+#include <stdio.h>
+#include <string.h>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+uint64_t hash_scene(const Scene& scene)
+{
+    uint64_t hash = HASH_SEED;
+
+    hash = hash_bytes(scene.m_vertices.data(), scene.m_vertices.size() * sizeof(SceneVertex), hash);
+    hash = hash_bytes(scene.m_indices.data(), scene.m_indices.size() * sizeof(uint32_t), hash);
+    hash = hash_bytes(scene.m_submeshes.data(), scene.m_submeshes.size() * sizeof(SceneSubMesh), hash);
+
+    return hash;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+uint64_t hash_scene(const InstancedScene& scene)
+{
+    uint64_t hash = HASH_SEED;
+
+    for (const Scene* mesh : scene.m_meshes)
+        hash = hash_value(hash_scene(*mesh), hash);
+
+    for (const SceneInstance& instance : scene.m_instances)
+    {
+        hash = hash_value(instance.mesh, hash);
+        hash = hash_value(instance.transform, hash);
+    }
+
+    return hash;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool write_bake_cache(const std::string& path, uint64_t key, int lightmap_size, const BakeCacheData& data)
+{
+    const size_t num_texels = size_t(lightmap_size) * size_t(lightmap_size);
+
+    if (data.accumulation.size() != num_texels || data.sample_counts.size() != num_texels || data.flags.size() != num_texels)
+        return false;
+
+    FILE* f = fopen(path.c_str(), "wb");
+
+    if (!f)
+        return false;
+
+    BakeCacheHeader header;
+
+    memset(&header, 0, sizeof(header));
+
+    header.magic         = BAKE_CACHE_MAGIC;
+    header.version       = BAKE_CACHE_VERSION;
+    header.key           = key;
+    header.lightmap_size = uint32_t(lightmap_size);
+
+    bool success = fwrite(&header, sizeof(header), 1, f) == 1;
+
+    success = success && fwrite(data.accumulation.data(), sizeof(glm::vec4), num_texels, f) == num_texels;
+    success = success && fwrite(data.sample_counts.data(), sizeof(uint32_t), num_texels, f) == num_texels;
+    success = success && fwrite(data.flags.data(), sizeof(uint8_t), num_texels, f) == num_texels;
+
+    return fclose(f) == 0 && success;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool read_bake_cache(const std::string& path, uint64_t key, int lightmap_size, BakeCacheData& data)
+{
+    MappedFile file;
+
+    if (!file.open(path) || file.m_size < sizeof(BakeCacheHeader))
+        return false;
+
+    const BakeCacheHeader* header     = (const BakeCacheHeader*)file.m_data;
+    const size_t           num_texels = size_t(lightmap_size) * size_t(lightmap_size);
+
+    if (header->magic != BAKE_CACHE_MAGIC || header->version != BAKE_CACHE_VERSION || header->key != key || header->lightmap_size != uint32_t(lightmap_size))
+        return false;
+
+    if (file.m_size != sizeof(BakeCacheHeader) + num_texels * (sizeof(glm::vec4) + sizeof(uint32_t) + sizeof(uint8_t)))
+        return false;
+
+    const uint8_t* accumulation  = file.m_data + sizeof(BakeCacheHeader);
+    const uint8_t* sample_counts = accumulation + num_texels * sizeof(glm::vec4);
+    const uint8_t* flags         = sample_counts + num_texels * sizeof(uint32_t);
+
+    data.accumulation.resize(num_texels);
+    data.sample_counts.resize(num_texels);
+    data.flags.resize(num_texels);
+
+    memcpy(data.accumulation.data(), accumulation, num_texels * sizeof(glm::vec4));
+    memcpy(data.sample_counts.data(), sample_counts, num_texels * sizeof(uint32_t));
+    memcpy(data.flags.data(), flags, num_texels * sizeof(uint8_t));
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool write_bake_partial(const std::string& path, uint64_t key, int lightmap_size, const BakePartialData& data)
+{
+    const size_t num_points = data.texels.size();
+
+    if (data.accumulation.size() != num_points || data.sample_counts.size() != num_points || data.gutter.size() != num_points)
+        return false;
+
+    FILE* f = fopen(path.c_str(), "wb");
+
+    if (!f)
+        return false;
+
+    BakePartialHeader header;
+
+    memset(&header, 0, sizeof(header));
+
+    header.magic         = BAKE_PARTIAL_MAGIC;
+    header.version       = BAKE_PARTIAL_VERSION;
+    header.key           = key;
+    header.lightmap_size = uint32_t(lightmap_size);
+    header.point_count   = uint32_t(num_points);
+
+    bool success = fwrite(&header, sizeof(header), 1, f) == 1;
+
+    success = success && fwrite(data.accumulation.data(), sizeof(glm::vec4), num_points, f) == num_points;
+    success = success && fwrite(data.texels.data(), sizeof(uint32_t), num_points, f) == num_points;
+    success = success && fwrite(data.sample_counts.data(), sizeof(uint32_t), num_points, f) == num_points;
+    success = success && fwrite(data.gutter.data(), sizeof(uint8_t), num_points, f) == num_points;
+
+    return fclose(f) == 0 && success;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool read_bake_partial(const std::string& path, uint64_t key, int lightmap_size, BakePartialData& data)
+{
+    MappedFile file;
+
+    if (!file.open(path) || file.m_size < sizeof(BakePartialHeader))
+        return false;
+
+    const BakePartialHeader* header     = (const BakePartialHeader*)file.m_data;
+    const size_t             num_points = header->point_count;
+
+    if (header->magic != BAKE_PARTIAL_MAGIC || header->version != BAKE_PARTIAL_VERSION || header->key != key || header->lightmap_size != uint32_t(lightmap_size))
+        return false;
+
+    if (file.m_size != sizeof(BakePartialHeader) + num_points * (sizeof(glm::vec4) + 2 * sizeof(uint32_t) + sizeof(uint8_t)))
+        return false;
+
+    const uint8_t* accumulation  = file.m_data + sizeof(BakePartialHeader);
+    const uint8_t* texels        = accumulation + num_points * sizeof(glm::vec4);
+    const uint8_t* sample_counts = texels + num_points * sizeof(uint32_t);
+    const uint8_t* gutter        = sample_counts + num_points * sizeof(uint32_t);
+
+    data.accumulation.resize(num_points);
+    data.texels.resize(num_points);
+    data.sample_counts.resize(num_points);
+    data.gutter.resize(num_points);
+
+    memcpy(data.accumulation.data(), accumulation, num_points * sizeof(glm::vec4));
+    memcpy(data.texels.data(), texels, num_points * sizeof(uint32_t));
+    memcpy(data.sample_counts.data(), sample_counts, num_points * sizeof(uint32_t));
+    memcpy(data.gutter.data(), gutter, num_points * sizeof(uint8_t));
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "scene.h"
+#include <ogl.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define BAKE_CACHE_MAGIC 0x43424d4c // "LMBC"
+#define BAKE_CACHE_VERSION 2
+
+// Texel flags of a bake cache.
+#define BAKE_CACHE_TEXEL_COVERED 1 // Not a gutter texel
+#define BAKE_CACHE_TEXEL_PENDING 2 // Still to be baked by the interrupted bake this cache is a checkpoint of
+
+// File layout: the header, followed by lightmap_size^2 accumulation texels (vec4), sample counts (uint32) and texel
+// flags (uint8). The header is 32 bytes so the accumulation stays 16-byte aligned.
+struct BakeCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint32_t lightmap_size;
+    uint32_t reserved[3];
+};
+
+// Raw accumulation state of a bake, enough to rebuild the framebuffer or to keep adding samples to it. As the random
+// numbers of a sample only depend on its texel and index, the sample counts are also where every texel's sequence
+// carries on from.
+struct BakeCacheData
+{
+    std::vector<glm::vec4> accumulation;
+    std::vector<uint32_t>  sample_counts;
+    std::vector<uint8_t>   flags;
+};
+
+#define BAKE_PARTIAL_MAGIC 0x50424d4c // "LMBP"
+#define BAKE_PARTIAL_VERSION 1
+
+// A partial bake holds the accumulation of a subset of the bake points, e.g. those of one job of a distributed bake.
+// File layout: the header, followed by point_count accumulation texels (vec4), atlas texel indices (uint32), sample
+// counts (uint32) and gutter flags (uint8).
+struct BakePartialHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint32_t lightmap_size;
+    uint32_t point_count;
+    uint32_t reserved[2];
+};
+
+struct BakePartialData
+{
+    std::vector<glm::vec4> accumulation;
+    std::vector<uint32_t>  texels;
+    std::vector<uint32_t>  sample_counts;
+    std::vector<uint8_t>   gutter;
+};
+
+// Content hash of the scene geometry and materials.
+uint64_t hash_scene(const Scene& scene);
+
+// Content hash of every mesh and of the instance placements.
+uint64_t hash_scene(const InstancedScene& scene);
+
+bool write_bake_cache(const std::string& path, uint64_t key, int lightmap_size, const BakeCacheData& data);
+
+// Memory maps the cache and copies it into data. Fails if the file is missing, has another version or was baked from a
+// different key or lightmap size.
+bool read_bake_cache(const std::string& path, uint64_t key, int lightmap_size, BakeCacheData& data);
+
+bool write_bake_partial(const std::string& path, uint64_t key, int lightmap_size, const BakePartialData& data);
+
+// Fails like read_bake_cache() does, so partials of another scene or other settings are never merged.
+bool read_bake_partial(const std::string& path, uint64_t key, int lightmap_size, BakePartialData& data);
@@ -0,0 +1,69 @@
+#include "bake_stats.h"
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void BakeCounters::add(const BakeCounters& other)
+{
+    paths += other.paths;
+    rays += other.rays;
+    shadow_rays += other.shadow_rays;
+    sky_escapes += other.sky_escapes;
+    gutter_texels += other.gutter_texels;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void BakeStats::reset_bake()
+{
+    for (int i = BAKE_PHASE_BAKE; i < BAKE_PHASE_COUNT; i++)
+        phase_seconds[i] = 0.0;
+
+    counters = BakeCounters();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+double BakeStats::total_seconds() const
+{
+    double total = 0.0;
+
+    for (int i = 0; i < BAKE_PHASE_COUNT; i++)
+        total += phase_seconds[i];
+
+    return total;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+ScopedPhaseTimer::ScopedPhaseTimer(BakeStats& stats, BakePhase phase) :
+    m_stats(stats), m_phase(phase), m_start(std::chrono::high_resolution_clock::now())
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+ScopedPhaseTimer::~ScopedPhaseTimer()
+{
+    m_stats.phase_seconds[m_phase] += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - m_start).count();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+const char* bake_phase_name(BakePhase phase)
+{
+    static const char* names[BAKE_PHASE_COUNT] = {
+        "load_scene",
+        "unwrap",
+        "embree_build",
+        "bake_points",
+        "sky",
+        "bake",
+        "denoise",
+        "dilate",
+        "write"
+    };
+
+    return names[phase];
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
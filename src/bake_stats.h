@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+
+// Stages of going from a scene file to a written lightmap, in pipeline order.
+enum BakePhase
+{
+    BAKE_PHASE_LOAD_SCENE = 0,
+    BAKE_PHASE_UNWRAP,
+    BAKE_PHASE_EMBREE_BUILD,
+    BAKE_PHASE_BAKE_POINTS,
+    BAKE_PHASE_SKY,
+    BAKE_PHASE_BAKE,
+    BAKE_PHASE_DENOISE,
+    BAKE_PHASE_DILATE,
+    BAKE_PHASE_WRITE,
+    BAKE_PHASE_COUNT
+};
+
+// Work done by the path tracer. Bake tasks count into their own copy and add it to the baker's when they finish.
+struct BakeCounters
+{
+    void add(const BakeCounters& other);
+
+    uint64_t paths         = 0;
+    uint64_t rays          = 0; // Bounce rays, one per path segment
+    uint64_t shadow_rays   = 0; // Toward the sun and the sky
+    uint64_t sky_escapes   = 0; // Bounce rays that left the scene
+    uint64_t gutter_texels = 0; // Bake points whose first bounce hit a back face
+};
+
+// Wall-clock time per phase, in seconds, and the counters of the bake. Phases that run more than once, e.g. once per
+// atlas page, add up.
+struct BakeStats
+{
+    void   reset_bake(); // Clears the phases from BAKE_PHASE_BAKE on and the counters, ahead of a new bake
+    double total_seconds() const;
+
+    double       phase_seconds[BAKE_PHASE_COUNT] = {};
+    BakeCounters counters;
+};
+
+// Adds the time between its construction and destruction to one phase.
+struct ScopedPhaseTimer
+{
+    ScopedPhaseTimer(BakeStats& stats, BakePhase phase);
+    ScopedPhaseTimer(const ScopedPhaseTimer&) = delete;
+    ScopedPhaseTimer& operator=(const ScopedPhaseTimer&) = delete;
+    ~ScopedPhaseTimer();
+
+    BakeStats&                                     m_stats;
+    BakePhase                                      m_phase;
+    std::chrono::high_resolution_clock::time_point m_start;
+};
+
+// Name of a phase as it appears in the GUI and in bake reports.
+const char* bake_phase_name(BakePhase phase);
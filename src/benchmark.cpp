@@ -0,0 +1,484 @@
+#include "lightmap_baker.h"
+#include "random.h"
+#include "skybox.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Microbenchmarks of the bake hot paths on procedural scenes, so they run without any assets, window or GL context.
+//
+// Usage: PrecomputedGI-Benchmark [--size <texels>] [--spp <samples>] [--bounces <bounces>] [--paths <count>]
+//                                [--scene <cornell_box|plane_field|many_submeshes>] [--output <results.json>]
+//
+// Results are written as JSON, to stdout unless --output is given. Progress goes to stderr.
+
+#define BENCHMARK_EXIT_SUCCESS 0
+#define BENCHMARK_EXIT_INVALID_ARGUMENTS 1
+#define BENCHMARK_EXIT_FAILED 3
+#define BENCHMARK_EXIT_WRITE_FAILED 4
+
+#define BENCHMARK_PATHS 65536
+#define BENCHMARK_DIRECTIONS 4000000
+#define BENCHMARK_SKY_SAMPLES 200000
+
+typedef std::chrono::high_resolution_clock BenchmarkClock;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void print_usage()
+{
+    fprintf(stderr, "Usage: PrecomputedGI-Benchmark [--size <texels>] [--spp <samples>] [--bounces <bounces>] [--paths <count>] [--scene <cornell_box|plane_field|many_submeshes>] [--output <results.json>]\n");
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static bool parse_int(const char* str, int& value)
+{
+    char* end = nullptr;
+    long  v   = strtol(str, &end, 10);
+
+    if (end == str || *end != '\0' || v < 1)
+        return false;
+
+    value = int(v);
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static double seconds_since(BenchmarkClock::time_point start)
+{
+    return std::chrono::duration<double>(BenchmarkClock::now() - start).count();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void begin_submesh(Scene& scene, glm::vec3 albedo)
+{
+    SceneSubMesh submesh;
+
+    submesh.index_count = 0;
+    submesh.base_vertex = uint32_t(scene.m_vertex_storage.size());
+    submesh.base_index  = uint32_t(scene.m_index_storage.size());
+    submesh.max_extents = glm::vec3(-INFINITY);
+    submesh.min_extents = glm::vec3(INFINITY);
+    submesh.albedo      = albedo;
+
+    scene.m_submesh_storage.push_back(submesh);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Adds a rectangle facing cross(u, v), split into n x n quads, to the last submesh. Triangles wind counter-clockwise
+// seen from the front, like the ones of an OBJ file.
+static void add_quad(Scene& scene, glm::vec3 center, glm::vec3 u, glm::vec3 v, int n)
+{
+    SceneSubMesh&   submesh = scene.m_submesh_storage.back();
+    const glm::vec3 normal  = glm::normalize(glm::cross(u, v));
+    const uint32_t  base    = uint32_t(scene.m_vertex_storage.size()) - submesh.base_vertex;
+
+    for (int y = 0; y <= n; y++)
+    {
+        for (int x = 0; x <= n; x++)
+        {
+            SceneVertex vertex;
+
+            vertex.tex_coord = glm::vec2(float(x), float(y)) / float(n);
+            vertex.position  = center + u * (vertex.tex_coord.x * 2.0f - 1.0f) + v * (vertex.tex_coord.y * 2.0f - 1.0f);
+            vertex.normal    = normal;
+            vertex.tangent   = glm::normalize(u);
+            vertex.bitangent = glm::normalize(v);
+
+            submesh.max_extents = glm::max(submesh.max_extents, vertex.position);
+            submesh.min_extents = glm::min(submesh.min_extents, vertex.position);
+
+            scene.m_vertex_storage.push_back(vertex);
+        }
+    }
+
+    for (int y = 0; y < n; y++)
+    {
+        for (int x = 0; x < n; x++)
+        {
+            uint32_t i0 = base + y * (n + 1) + x;
+            uint32_t i1 = i0 + 1;
+            uint32_t i2 = i1 + (n + 1);
+            uint32_t i3 = i0 + (n + 1);
+
+            uint32_t indices[] = { i0, i1, i2, i0, i2, i3 };
+
+            scene.m_index_storage.insert(scene.m_index_storage.end(), indices, indices + 6);
+        }
+    }
+
+    submesh.index_count += n * n * 6;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Axis-aligned box with outward facing sides, added to the last submesh.
+static void add_box(Scene& scene, glm::vec3 center, glm::vec3 half_extents, int n)
+{
+    const glm::vec3 x = glm::vec3(half_extents.x, 0.0f, 0.0f);
+    const glm::vec3 y = glm::vec3(0.0f, half_extents.y, 0.0f);
+    const glm::vec3 z = glm::vec3(0.0f, 0.0f, half_extents.z);
+
+    add_quad(scene, center + x, y, z, n);
+    add_quad(scene, center - x, z, y, n);
+    add_quad(scene, center + y, z, x, n);
+    add_quad(scene, center - y, x, z, n);
+    add_quad(scene, center + z, x, y, n);
+    add_quad(scene, center - z, y, x, n);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void finish_scene(Scene& scene)
+{
+    scene.m_vertices  = ArrayView<SceneVertex>(scene.m_vertex_storage.data(), scene.m_vertex_storage.size());
+    scene.m_indices   = ArrayView<uint32_t>(scene.m_index_storage.data(), scene.m_index_storage.size());
+    scene.m_submeshes = ArrayView<SceneSubMesh>(scene.m_submesh_storage.data(), scene.m_submesh_storage.size());
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Closed on every side but the front, with two boxes inside: mostly occluded paths that bounce the full depth.
+static void create_cornell_box(Scene& scene)
+{
+    const glm::vec3 x = glm::vec3(1.0f, 0.0f, 0.0f);
+    const glm::vec3 y = glm::vec3(0.0f, 1.0f, 0.0f);
+    const glm::vec3 z = glm::vec3(0.0f, 0.0f, 1.0f);
+
+    begin_submesh(scene, glm::vec3(0.73f));
+    add_quad(scene, -y, z, x, 16);
+    add_quad(scene, y, x, z, 16);
+    add_quad(scene, -z, x, y, 16);
+    add_box(scene, glm::vec3(0.35f, -0.7f, 0.3f), glm::vec3(0.3f), 4);
+    add_box(scene, glm::vec3(-0.35f, -0.4f, -0.3f), glm::vec3(0.3f, 0.6f, 0.3f), 4);
+
+    begin_submesh(scene, glm::vec3(0.65f, 0.05f, 0.05f));
+    add_quad(scene, -x, y, z, 16);
+
+    begin_submesh(scene, glm::vec3(0.12f, 0.45f, 0.15f));
+    add_quad(scene, x, z, y, 16);
+
+    finish_scene(scene);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// A wide open field of densely tessellated ground patches with a block on each: many triangles, most paths escape.
+static void create_plane_field(Scene& scene)
+{
+    const int   patches = 16;
+    const float extent  = 2.0f;
+
+    begin_submesh(scene, glm::vec3(0.5f));
+
+    for (int j = 0; j < patches; j++)
+    {
+        for (int i = 0; i < patches; i++)
+        {
+            glm::vec3 center = glm::vec3((i - patches / 2) * extent, 0.0f, (j - patches / 2) * extent);
+
+            add_quad(scene, center, glm::vec3(0.0f, 0.0f, extent * 0.5f), glm::vec3(extent * 0.5f, 0.0f, 0.0f), 8);
+        }
+    }
+
+    begin_submesh(scene, glm::vec3(0.7f, 0.6f, 0.5f));
+
+    for (int j = 0; j < patches; j++)
+    {
+        for (int i = 0; i < patches; i++)
+        {
+            glm::vec3 center = glm::vec3((i - patches / 2) * extent, 0.5f, (j - patches / 2) * extent);
+
+            add_box(scene, center, glm::vec3(0.3f, 0.5f, 0.3f), 2);
+        }
+    }
+
+    finish_scene(scene);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// A grid of small cubes, each one its own submesh: stresses per-submesh work in the unwrap and the Embree build.
+static void create_many_submeshes(Scene& scene)
+{
+    const int cubes = 32;
+
+    begin_submesh(scene, glm::vec3(0.5f));
+    add_quad(scene, glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, cubes * 0.5f), glm::vec3(cubes * 0.5f, 0.0f, 0.0f), 16);
+
+    for (int j = 0; j < cubes; j++)
+    {
+        for (int i = 0; i < cubes; i++)
+        {
+            uint32_t  index  = j * cubes + i;
+            glm::vec3 albedo = glm::vec3(random_float(index, 0, 0, 0), random_float(index, 0, 0, 1), random_float(index, 0, 0, 2)) * 0.8f;
+
+            begin_submesh(scene, albedo);
+            add_box(scene, glm::vec3(i - cubes * 0.5f + 0.5f, 0.3f, j - cubes * 0.5f + 0.5f), glm::vec3(0.3f), 1);
+        }
+    }
+
+    finish_scene(scene);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+struct SceneResult
+{
+    std::string name;
+    uint32_t    triangles;
+    uint32_t    submeshes;
+    uint32_t    bake_points;
+    double      unwrap_seconds;
+    double      embree_build_seconds;
+    uint64_t    paths;
+    uint64_t    rays;
+    double      path_trace_seconds;
+    uint64_t    bake_samples;
+    double      bake_seconds;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static bool benchmark_scene(const std::string& name, const Scene& scene, Skybox& skybox, int size, int spp, int bounces, int max_paths, SceneResult& result)
+{
+    InstancedScene instanced_scene;
+
+    instanced_scene.m_meshes.push_back(&scene);
+    instanced_scene.m_instances.push_back({ 0, glm::mat4(1.0f) });
+
+    LightmapBaker baker;
+
+    baker.m_lightmap_size = size;
+    baker.m_num_samples   = spp;
+    baker.m_num_bounces   = bounces;
+    baker.m_skybox        = &skybox;
+
+    result.name      = name;
+    result.triangles = uint32_t(scene.m_indices.size() / 3);
+    result.submeshes = uint32_t(scene.m_submeshes.size());
+
+    fprintf(stderr, "%s: %u triangles, %u submeshes\n", name.c_str(), result.triangles, result.submeshes);
+
+    auto start = BenchmarkClock::now();
+
+    if (!baker.lightmap_uv_unwrap(instanced_scene))
+        return false;
+
+    result.unwrap_seconds = seconds_since(start);
+
+    start = BenchmarkClock::now();
+
+    if (!baker.initialize_embree(instanced_scene))
+        return false;
+
+    result.embree_build_seconds = seconds_since(start);
+
+    baker.set_region(glm::ivec2(0), glm::ivec2(size));
+    baker.initialize_bake_points(true);
+
+    result.bake_points = uint32_t(baker.m_bake_points.size());
+
+    if (baker.m_bake_points.empty())
+        return false;
+
+    // Whole bake over the thread pool, with the stream tracer and tiling of a regular bake.
+    start = BenchmarkClock::now();
+
+    baker.bake();
+    baker.wait();
+
+    result.bake_seconds = seconds_since(start);
+    result.bake_samples = uint64_t(baker.m_bake_points.size()) * spp;
+
+    // Single-threaded scalar paths, counting bounce and shadow rays alike. They run after the bake, which sets up the
+    // bounce count the tracers use.
+    BakeCounters counters;
+    glm::vec3    sink = glm::vec3(0.0f);
+
+    result.paths = 0;
+
+    start = BenchmarkClock::now();
+
+    for (uint32_t i = 0; result.paths < uint64_t(max_paths); i = (i + 1) % baker.m_bake_points.size())
+    {
+        bool gutter = false;
+
+        sink += baker.path_trace(baker.m_bake_points.directions[i], baker.m_bake_points.positions[i], baker.m_bake_points.texels[i], uint32_t(result.paths / baker.m_bake_points.size()), gutter, nullptr, nullptr, &counters);
+
+        result.paths++;
+    }
+
+    result.path_trace_seconds = seconds_since(start);
+    result.rays               = counters.rays + counters.shadow_rays;
+
+    if (sink.x < 0.0f)
+        fprintf(stderr, "%f\n", sink.x);
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void write_scene_result(FILE* f, const SceneResult& result, bool last)
+{
+    fprintf(f, "    {\n");
+    fprintf(f, "      \"name\": \"%s\",\n", result.name.c_str());
+    fprintf(f, "      \"triangles\": %u,\n", result.triangles);
+    fprintf(f, "      \"submeshes\": %u,\n", result.submeshes);
+    fprintf(f, "      \"bake_points\": %u,\n", result.bake_points);
+    fprintf(f, "      \"unwrap_seconds\": %.6f,\n", result.unwrap_seconds);
+    fprintf(f, "      \"embree_build_seconds\": %.6f,\n", result.embree_build_seconds);
+    fprintf(f, "      \"path_trace_paths_per_second\": %.1f,\n", result.paths / result.path_trace_seconds);
+    fprintf(f, "      \"path_trace_rays_per_second\": %.1f,\n", result.rays / result.path_trace_seconds);
+    fprintf(f, "      \"bake_seconds\": %.6f,\n", result.bake_seconds);
+    fprintf(f, "      \"bake_samples_per_second\": %.1f\n", result.bake_samples / result.bake_seconds);
+    fprintf(f, "    }%s\n", last ? "" : ",");
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+int main(int argc, const char* argv[])
+{
+    int         size      = 512;
+    int         spp       = 4;
+    int         bounces   = LIGHTMAP_BOUNCES;
+    int         max_paths = BENCHMARK_PATHS;
+    std::string scene_filter;
+    std::string output_path;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+
+        if ((strcmp(argv[i], "--size") == 0 && has_value && parse_int(argv[i + 1], size)) ||
+            (strcmp(argv[i], "--spp") == 0 && has_value && parse_int(argv[i + 1], spp)) ||
+            (strcmp(argv[i], "--bounces") == 0 && has_value && parse_int(argv[i + 1], bounces)) ||
+            (strcmp(argv[i], "--paths") == 0 && has_value && parse_int(argv[i + 1], max_paths)))
+            i++;
+        else if (strcmp(argv[i], "--scene") == 0 && has_value)
+            scene_filter = argv[++i];
+        else if (strcmp(argv[i], "--output") == 0 && has_value)
+            output_path = argv[++i];
+        else
+        {
+            print_usage();
+            return BENCHMARK_EXIT_INVALID_ARGUMENTS;
+        }
+    }
+
+    LightmapBaker baker;
+    Skybox        skybox;
+
+    if (!skybox.initialize(-baker.m_light_direction, glm::vec3(0.5f), 2.0f, false, &baker.m_thread_pool))
+    {
+        fprintf(stderr, "Failed to initialize sky model\n");
+        return BENCHMARK_EXIT_FAILED;
+    }
+
+    // Kernels, on directions that cover the whole sphere.
+    glm::vec3 sink  = glm::vec3(0.0f);
+    auto      start = BenchmarkClock::now();
+
+    for (uint32_t i = 0; i < BENCHMARK_DIRECTIONS; i++)
+    {
+        glm::vec3 n = glm::normalize(glm::vec3(random_float(i, 0, 0, 4), random_float(i, 0, 0, 5), random_float(i, 0, 0, 6)) - 0.5f);
+        sink += baker.sample_cosine_lobe_direction(n, i, 0, 0);
+    }
+
+    double cosine_lobe_seconds = seconds_since(start);
+
+    std::vector<glm::vec3> sky_directions(BENCHMARK_SKY_SAMPLES);
+
+    for (uint32_t i = 0; i < BENCHMARK_SKY_SAMPLES; i++)
+        sky_directions[i] = baker.sample_cosine_lobe_direction(glm::vec3(0.0f, 1.0f, 0.0f), i, 0, 0);
+
+    start = BenchmarkClock::now();
+
+    for (const glm::vec3& d : sky_directions)
+        sink += skybox.sample_sky(d);
+
+    double sample_sky_seconds = seconds_since(start);
+
+    start = BenchmarkClock::now();
+
+    for (const glm::vec3& d : sky_directions)
+        sink += skybox.lookup_sky(d);
+
+    double lookup_sky_seconds = seconds_since(start);
+
+    if (sink.x < 0.0f)
+        fprintf(stderr, "%f\n", sink.x);
+
+    // Scenes
+    typedef void (*CreateScene)(Scene&);
+
+    const char*       scene_names[]   = { "cornell_box", "plane_field", "many_submeshes" };
+    const CreateScene scene_creates[] = { create_cornell_box, create_plane_field, create_many_submeshes };
+
+    std::vector<SceneResult> results;
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (!scene_filter.empty() && scene_filter != scene_names[i])
+            continue;
+
+        Scene       scene;
+        SceneResult result;
+
+        scene_creates[i](scene);
+
+        if (!benchmark_scene(scene_names[i], scene, skybox, size, spp, bounces, max_paths, result))
+        {
+            fprintf(stderr, "Failed to benchmark scene: %s\n", scene_names[i]);
+            return BENCHMARK_EXIT_FAILED;
+        }
+
+        results.push_back(result);
+    }
+
+    if (results.empty() && !scene_filter.empty())
+    {
+        print_usage();
+        return BENCHMARK_EXIT_INVALID_ARGUMENTS;
+    }
+
+    FILE* f = output_path.empty() ? stdout : fopen(output_path.c_str(), "w");
+
+    if (!f)
+    {
+        fprintf(stderr, "Failed to write results: %s\n", output_path.c_str());
+        return BENCHMARK_EXIT_WRITE_FAILED;
+    }
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"lightmap_size\": %d,\n", size);
+    fprintf(f, "  \"spp\": %d,\n", spp);
+    fprintf(f, "  \"bounces\": %d,\n", bounces);
+    fprintf(f, "  \"threads\": %u,\n", uint32_t(baker.m_thread_pool.num_worker_threads()));
+    fprintf(f, "  \"sample_cosine_lobe_direction_per_second\": %.1f,\n", BENCHMARK_DIRECTIONS / cosine_lobe_seconds);
+    fprintf(f, "  \"sample_sky_nanoseconds\": %.2f,\n", sample_sky_seconds * 1e9 / BENCHMARK_SKY_SAMPLES);
+    fprintf(f, "  \"lookup_sky_nanoseconds\": %.2f,\n", lookup_sky_seconds * 1e9 / BENCHMARK_SKY_SAMPLES);
+    fprintf(f, "  \"scenes\": [\n");
+
+    for (size_t i = 0; i < results.size(); i++)
+        write_scene_result(f, results[i], i + 1 == results.size());
+
+    fprintf(f, "  ]\n");
+    fprintf(f, "}\n");
+
+    bool success = f == stdout ? fflush(f) == 0 : fclose(f) == 0;
+
+    return success ? BENCHMARK_EXIT_SUCCESS : BENCHMARK_EXIT_WRITE_FAILED;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 64-bit FNV-1a, used to key on-disk caches by their inputs. Pass the previous result as the seed to hash several
+// buffers as one.
+
+#define HASH_SEED 0xcbf29ce484222325ull
+
+inline uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = HASH_SEED)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint64_t       hash  = seed;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+template <typename T>
+inline uint64_t hash_value(const T& value, uint64_t seed = HASH_SEED)
+{
+    return hash_bytes(&value, sizeof(T), seed);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
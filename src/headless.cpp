@@ -0,0 +1,702 @@
+#include "headless.h"
+#include "lightmap_baker.h"
+#include "skybox.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define HEADLESS_EXIT_SUCCESS 0
+#define HEADLESS_EXIT_INVALID_ARGUMENTS 1
+#define HEADLESS_EXIT_LOAD_FAILED 2
+#define HEADLESS_EXIT_BAKE_FAILED 3
+#define HEADLESS_EXIT_WRITE_FAILED 4
+
+#if defined(_WIN32)
+#define popen _popen
+#define pclose _pclose
+#endif
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void print_usage()
+{
+    fprintf(stderr, "Usage: PrecomputedGI --bake <scene.obj|scene.lmscene|scene.lmdesc> [--size <texels>] [--spp <samples>] [--bounces <bounces>] [--adaptive <max samples>] [--threshold <relative error>] [--scalar] [--spatial-order] [--no-sky-sampling] [--denoise] [--scenario <x,y,z[,turbidity]>]... [--cache <bake.cache> [--resume] [--checkpoint <seconds>]] [--unwrap-cache <unwrap.cache>] [--texels-per-unit <texels>] [--page <index>] [--stream <tile texels>] [--workers <count> | --jobs <count> --job <index> --partial <job.partial> | --merge <job.partial>...] [--threads <count>] [--write-scene <scene.lmscene>] [--report <report.json>] [--output <lightmap.hdr>]\n");
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static bool parse_int(const char* str, int& value, int min_value = 1)
+{
+    char* end = nullptr;
+    long  v   = strtol(str, &end, 10);
+
+    if (end == str || *end != '\0' || v < min_value)
+        return false;
+
+    value = int(v);
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static bool parse_float(const char* str, float& value)
+{
+    char* end = nullptr;
+    float v   = strtof(str, &end);
+
+    if (end == str || *end != '\0' || v <= 0.0f)
+        return false;
+
+    value = v;
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+struct HeadlessScenario
+{
+    glm::vec3 light_direction;
+    float     turbidity;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static bool parse_scenario(const char* str, HeadlessScenario& scenario)
+{
+    scenario.turbidity = 2.0f;
+
+    int count = sscanf(str, "%f,%f,%f,%f", &scenario.light_direction.x, &scenario.light_direction.y, &scenario.light_direction.z, &scenario.turbidity);
+
+    if (count < 3 || glm::length(scenario.light_direction) == 0.0f || scenario.turbidity <= 0.0f)
+        return false;
+
+    scenario.light_direction = glm::normalize(scenario.light_direction);
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// lightmap.hdr, _<index> -> lightmap_<index>.hdr
+static std::string suffixed_path(const std::string& path, const std::string& suffix)
+{
+    size_t dot   = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return path + suffix;
+
+    return path.substr(0, dot) + suffix + path.substr(dot);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// lightmap.hdr -> lightmap[_page<page>][_<scenario>].hdr
+static std::string lightmap_output_path(const std::string& path, const std::string& page_suffix, uint32_t scenario, uint32_t num_scenarios)
+{
+    return suffixed_path(path, num_scenarios == 1 ? page_suffix : page_suffix + "_" + std::to_string(scenario));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static std::string quote_argument(const std::string& argument)
+{
+#if defined(_WIN32)
+    return "\"" + argument + "\"";
+#else
+    std::string quoted = "'";
+
+    for (char c : argument)
+        quoted += c == '\'' ? std::string("'\\''") : std::string(1, c);
+
+    return quoted + "'";
+#endif
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Local coordinator of a distributed bake: runs num_workers copies of this executable with the same arguments, each
+// baking one job of the page into its own partial bake on num_threads threads, and forwards their output through
+// pipes. The partial paths are returned in job order, ready to be merged.
+static bool run_workers(int                       argc,
+                        const char*               argv[],
+                        int                       num_workers,
+                        int                       num_threads,
+                        uint32_t                  page,
+                        const std::string&        unwrap_cache_path,
+                        const std::string&        output_path,
+                        const std::string&        page_suffix,
+                        std::vector<std::string>& partials)
+{
+    std::string arguments;
+
+    // The coordinator already wrote the scene, writes the bake report and decides on the unwrap cache shared by all
+    // workers and on how many threads each of them gets.
+    for (int i = 1; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "--workers") == 0 || strcmp(argv[i], "--write-scene") == 0 || strcmp(argv[i], "--report") == 0 || strcmp(argv[i], "--unwrap-cache") == 0 || strcmp(argv[i], "--threads") == 0) && i + 1 < argc)
+            i++;
+        else
+            arguments += " " + quote_argument(argv[i]);
+    }
+
+    arguments += " --unwrap-cache " + quote_argument(unwrap_cache_path) + " --page " + std::to_string(page) + " --jobs " + std::to_string(num_workers) + " --threads " + std::to_string(num_threads);
+
+    std::vector<FILE*> pipes;
+
+    partials.clear();
+
+    for (int i = 0; i < num_workers; i++)
+    {
+        partials.push_back(suffixed_path(output_path, page_suffix + "_job" + std::to_string(i)) + ".partial");
+
+        std::string command = quote_argument(argv[0]) + arguments + " --job " + std::to_string(i) + " --partial " + quote_argument(partials.back());
+
+#if defined(_WIN32)
+        // cmd.exe strips the first and last quote of the whole command line.
+        command = "\"" + command + "\"";
+#endif
+
+        FILE* pipe = popen(command.c_str(), "r");
+
+        if (!pipe)
+        {
+            fprintf(stderr, "Failed to start worker %d\n", i);
+            break;
+        }
+
+        pipes.push_back(pipe);
+    }
+
+    bool success = pipes.size() == partials.size();
+
+    for (uint32_t i = 0; i < pipes.size(); i++)
+    {
+        char line[1024];
+
+        while (fgets(line, sizeof(line), pipes[i]))
+            printf("[job %u] %s", i, line);
+
+        if (pclose(pipes[i]) != 0)
+        {
+            fprintf(stderr, "Worker %u failed\n", i);
+            success = false;
+        }
+    }
+
+    return success;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool is_headless_bake(int argc, const char* argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--bake") == 0)
+            return true;
+    }
+
+    return false;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+int headless_bake(int argc, const char* argv[])
+{
+    std::string scene_path;
+    std::string output_path = "lightmap.hdr";
+    std::string cache_path;
+    std::string unwrap_cache_path;
+    std::string scene_output_path;
+    std::string report_path;
+    int         size        = LIGHTMAP_TEXTURE_SIZE;
+    int         spp         = LIGHTMAP_SPP;
+    int         bounces     = LIGHTMAP_BOUNCES;
+    int         max_samples = 0;
+    float       threshold   = LIGHTMAP_ERROR_THRESHOLD;
+    float       density     = 0.0f;
+    int         page        = -1;
+    int         stream      = 0;
+    int         checkpoint  = 0;
+    int         workers     = 0;
+    int         threads     = 0;
+    int         num_jobs    = 0;
+    int         job         = -1;
+    bool        scalar      = false;
+    bool        spatial     = false;
+    bool        sky         = true;
+    bool        denoise     = false;
+    bool        resume      = false;
+    std::string partial_path;
+
+    std::vector<HeadlessScenario> scenarios;
+    std::vector<std::string>      merge_paths;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+
+        if (strcmp(argv[i], "--bake") == 0 && has_value)
+            scene_path = argv[++i];
+        else if (strcmp(argv[i], "--size") == 0 && has_value)
+        {
+            if (!parse_int(argv[++i], size))
+            {
+                print_usage();
+                return HEADLESS_EXIT_INVALID_ARGUMENTS;
+            }
+        }
+        else if (strcmp(argv[i], "--spp") == 0 && has_value)
+        {
+            if (!parse_int(argv[++i], spp))
+            {
+                print_usage();
+                return HEADLESS_EXIT_INVALID_ARGUMENTS;
+            }
+        }
+        else if (strcmp(argv[i], "--bounces") == 0 && has_value)
+        {
+            if (!parse_int(argv[++i], bounces))
+            {
+                print_usage();
+                return HEADLESS_EXIT_INVALID_ARGUMENTS;
+            }
+        }
+        else if (strcmp(argv[i], "--adaptive") == 0 && has_value)
+        {
+            if (!parse_int(argv[++i], max_samples))
+            {
+                print_usage();
+                return HEADLESS_EXIT_INVALID_ARGUMENTS;
+            }
+        }
+        else if (strcmp(argv[i], "--threshold") == 0 && has_value)
+        {
+            if (!parse_float(argv[++i], threshold))
+            {
+                print_usage();
+                return HEADLESS_EXIT_INVALID_ARGUMENTS;
+            }
+        }
+        else if (strcmp(argv[i], "--scalar") == 0)
+            scalar = true;
+        else if (strcmp(argv[i], "--spatial-order") == 0)
+            spatial = true;
+        else if (strcmp(argv[i], "--no-sky-sampling") == 0)
+            sky = false;
+        else if (strcmp(argv[i], "--denoise") == 0)
+            denoise = true;
+        else if (strcmp(argv[i], "--scenario") == 0 && has_value)
+        {
+            HeadlessScenario scenario;
+
+            if (!parse_scenario(argv[++i], scenario))
+            {
+                print_usage();
+                return HEADLESS_EXIT_INVALID_ARGUMENTS;
+            }
+
+            scenarios.push_back(scenario);
+        }
+        else if (strcmp(argv[i], "--cache") == 0 && has_value)
+            cache_path = argv[++i];
+        else if (strcmp(argv[i], "--resume") == 0)
+            resume = true;
+        else if (strcmp(argv[i], "--checkpoint") == 0 && has_value)
+        {
+            if (!parse_int(argv[++i], checkpoint))
+            {
+                print_usage();
+                return HEADLESS_EXIT_INVALID_ARGUMENTS;
+            }
+        }
+        else if (strcmp(argv[i], "--report") == 0 && has_value)
+            report_path = argv[++i];
+        else if (strcmp(argv[i], "--unwrap-cache") == 0 && has_value)
+            unwrap_cache_path = argv[++i];
+        else if (strcmp(argv[i], "--texels-per-unit") == 0 && has_value)
+        {
+            if (!parse_float(argv[++i], density))
+            {
+                print_usage();
+                return HEADLESS_EXIT_INVALID_ARGUMENTS;
+            }
+        }
+        else if (strcmp(argv[i], "--page") == 0 && has_value)
+        {
+            if (!parse_int(argv[++i], page, 0))
+            {
+                print_usage();
+                return HEADLESS_EXIT_INVALID_ARGUMENTS;
+            }
+        }
+        else if (strcmp(argv[i], "--stream") == 0 && has_value)
+        {
+            if (!parse_int(argv[++i], stream))
+            {
+                print_usage();
+                return HEADLESS_EXIT_INVALID_ARGUMENTS;
+            }
+        }
+        else if (strcmp(argv[i], "--workers") == 0 && has_value)
+        {
+            if (!parse_int(argv[++i], workers))
+            {
+                print_usage();
+                return HEADLESS_EXIT_INVALID_ARGUMENTS;
+            }
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && has_value)
+        {
+            if (!parse_int(argv[++i], threads))
+            {
+                print_usage();
+                return HEADLESS_EXIT_INVALID_ARGUMENTS;
+            }
+        }
+        else if (strcmp(argv[i], "--jobs") == 0 && has_value)
+        {
+            if (!parse_int(argv[++i], num_jobs))
+            {
+                print_usage();
+                return HEADLESS_EXIT_INVALID_ARGUMENTS;
+            }
+        }
+        else if (strcmp(argv[i], "--job") == 0 && has_value)
+        {
+            if (!parse_int(argv[++i], job, 0))
+            {
+                print_usage();
+                return HEADLESS_EXIT_INVALID_ARGUMENTS;
+            }
+        }
+        else if (strcmp(argv[i], "--partial") == 0 && has_value)
+            partial_path = argv[++i];
+        else if (strcmp(argv[i], "--merge") == 0 && has_value)
+            merge_paths.push_back(argv[++i]);
+        else if (strcmp(argv[i], "--write-scene") == 0 && has_value)
+            scene_output_path = argv[++i];
+        else if (strcmp(argv[i], "--output") == 0 && has_value)
+            output_path = argv[++i];
+        else
+        {
+            fprintf(stderr, "Unknown or incomplete argument: %s\n", argv[i]);
+            print_usage();
+            return HEADLESS_EXIT_INVALID_ARGUMENTS;
+        }
+    }
+
+    // A bake cache holds the accumulation of a single lighting state. Caches and denoising need the whole atlas in
+    // memory, which is exactly what a streamed bake avoids.
+    if (scene_path.empty() || (!cache_path.empty() && scenarios.size() > 1) || ((resume || checkpoint > 0) && cache_path.empty()) || (stream > 0 && (denoise || !cache_path.empty())))
+    {
+        print_usage();
+        return HEADLESS_EXIT_INVALID_ARGUMENTS;
+    }
+
+    // A distributed bake splits the bake points of one page and one lighting state, and uses exactly one of its modes.
+    bool distributed = workers > 0 || num_jobs > 0 || !merge_paths.empty();
+    int  modes       = (workers > 0 ? 1 : 0) + (num_jobs > 0 ? 1 : 0) + (merge_paths.empty() ? 0 : 1);
+
+    if ((distributed && (modes > 1 || scenarios.size() > 1 || stream > 0 || !cache_path.empty())) || (num_jobs > 0) != (job >= 0) || job >= num_jobs || (num_jobs > 0 && partial_path.empty()))
+    {
+        print_usage();
+        return HEADLESS_EXIT_INVALID_ARGUMENTS;
+    }
+
+    // Workers all read the unwrap of the coordinator instead of unwrapping the scene again. Unless it was asked for,
+    // that unwrap cache is only spooled for them.
+    bool spool_unwrap_cache = workers > 0 && unwrap_cache_path.empty();
+
+    if (spool_unwrap_cache)
+        unwrap_cache_path = output_path + ".unwrap";
+
+    // Local workers share the machine, so each one gets its share of the threads instead of all of them.
+    int worker_threads = std::max(1, (threads > 0 ? threads : int(std::thread::hardware_concurrency())) / std::max(workers, 1));
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    try
+    {
+        InstancedScene scene;
+        LightmapBaker  baker(threads);
+
+        {
+            ScopedPhaseTimer timer(baker.m_stats, BAKE_PHASE_LOAD_SCENE);
+
+            if (!scene.load(scene_path))
+            {
+                fprintf(stderr, "Failed to load scene: %s\n", scene_path.c_str());
+                return HEADLESS_EXIT_LOAD_FAILED;
+            }
+        }
+
+        // Scene files given on the command line are used as they are, but a stale one should not go unnoticed.
+        for (const Scene* mesh : scene.m_meshes)
+        {
+            if (mesh->is_stale())
+                fprintf(stderr, "Warning: a scene file used by %s is older than the OBJ it was converted from\n", scene_path.c_str());
+        }
+
+        if (!scene_output_path.empty())
+        {
+            if (scene.m_meshes.size() != 1 || !scene.m_meshes[0]->write_binary(scene_output_path))
+            {
+                fprintf(stderr, "Failed to write scene: %s\n", scene_output_path.c_str());
+                return HEADLESS_EXIT_WRITE_FAILED;
+            }
+
+            printf("Wrote %s\n", scene_output_path.c_str());
+        }
+
+        baker.m_lightmap_size     = size;
+        baker.m_num_samples       = spp;
+        baker.m_num_bounces       = bounces;
+        baker.m_stream_tracing    = !scalar;
+        baker.m_spatial_order     = spatial;
+        baker.m_sky_sampling      = sky;
+        baker.m_unwrap_cache_path = unwrap_cache_path;
+        baker.m_texels_per_unit   = density;
+        baker.m_stream_tile_size  = stream;
+
+        if (max_samples > 0)
+        {
+            baker.m_adaptive_sampling = true;
+            baker.m_max_samples       = max_samples;
+            baker.m_error_threshold   = threshold;
+        }
+
+        // Without any --scenario the default light direction and sky are baked on their own.
+        if (scenarios.empty())
+            scenarios.push_back({ baker.m_light_direction, 2.0f });
+
+        std::vector<std::unique_ptr<Skybox>> skyboxes;
+        std::vector<LightScenario>           light_scenarios;
+
+        for (const HeadlessScenario& scenario : scenarios)
+        {
+            ScopedPhaseTimer timer(baker.m_stats, BAKE_PHASE_SKY);
+
+            skyboxes.push_back(std::make_unique<Skybox>());
+
+            if (!skyboxes.back()->initialize(-scenario.light_direction, glm::vec3(0.5f), scenario.turbidity, false, &baker.m_thread_pool))
+            {
+                fprintf(stderr, "Failed to initialize sky model\n");
+                return HEADLESS_EXIT_BAKE_FAILED;
+            }
+
+            light_scenarios.push_back({ scenario.light_direction, skyboxes.back().get() });
+        }
+
+        if (!baker.initialize(scene, skyboxes[0].get()))
+        {
+            fprintf(stderr, "Failed to unwrap scene: %s\n", scene_path.c_str());
+            return HEADLESS_EXIT_BAKE_FAILED;
+        }
+
+        if (page >= int(baker.m_page_count))
+        {
+            fprintf(stderr, "Page %d is out of range, the atlas has %u pages\n", page, baker.m_page_count);
+            return HEADLESS_EXIT_INVALID_ARGUMENTS;
+        }
+
+        // Partial bakes are named by the caller, one per page.
+        if ((num_jobs > 0 || !merge_paths.empty()) && page < 0 && baker.m_page_count > 1)
+        {
+            fprintf(stderr, "The atlas has %u pages, pick one with --page\n", baker.m_page_count);
+            return HEADLESS_EXIT_INVALID_ARGUMENTS;
+        }
+
+        // Every page is baked on its own, from rasterization to output, so only one page is in memory at a time.
+        uint32_t first_page = page >= 0 ? uint32_t(page) : 0;
+        uint32_t end_page   = page >= 0 ? uint32_t(page) + 1 : baker.m_page_count;
+
+        for (uint32_t p = first_page; p < end_page; p++)
+        {
+            std::string page_suffix = baker.m_page_count > 1 ? "_page" + std::to_string(p) : "";
+            std::string page_cache  = cache_path.empty() ? cache_path : suffixed_path(cache_path, page_suffix);
+
+            baker.m_page                = p;
+            baker.m_checkpoint_path     = page_cache;
+            baker.m_checkpoint_interval = checkpoint;
+
+            if (stream > 0)
+            {
+                std::vector<std::string> paths;
+
+                for (uint32_t i = 0; i < light_scenarios.size(); i++)
+                    paths.push_back(lightmap_output_path(output_path, page_suffix, i, uint32_t(light_scenarios.size())));
+
+                printf("Streaming %s: page %u of %u, %dx%d atlas in %dx%d tiles, %d spp, %d bounces, %d scenarios\n", scene_path.c_str(), p + 1, baker.m_page_count, size, size, stream, stream, spp, bounces, int(scenarios.size()));
+
+                auto bake_start = std::chrono::high_resolution_clock::now();
+
+                if (!baker.bake_streamed(light_scenarios, paths))
+                {
+                    fprintf(stderr, "Failed to write lightmap: %s\n", paths[0].c_str());
+                    return HEADLESS_EXIT_WRITE_FAILED;
+                }
+
+                auto bake_end = std::chrono::high_resolution_clock::now();
+
+                printf("Baked in %.2f seconds\n", std::chrono::duration<double>(bake_end - bake_start).count());
+
+                for (const std::string& path : paths)
+                    printf("Wrote %s\n", path.c_str());
+
+                continue;
+            }
+
+            baker.initialize_bake_points(true);
+
+            // A worker of a distributed bake only bakes its own job and leaves the rest to the merge.
+            if (num_jobs > 0)
+            {
+                baker.select_job(job, num_jobs);
+
+                printf("Baking %s: page %u of %u, job %d of %d, %d bake points, %d spp, %d bounces\n", scene_path.c_str(), p + 1, baker.m_page_count, job + 1, num_jobs, int(baker.m_bake_points.size()), spp, bounces);
+
+                baker.m_light_direction = light_scenarios[0].light_direction;
+                baker.bake();
+                baker.wait();
+
+                if (!baker.save_bake_partial(partial_path))
+                {
+                    fprintf(stderr, "Failed to write partial bake: %s\n", partial_path.c_str());
+                    return HEADLESS_EXIT_WRITE_FAILED;
+                }
+
+                printf("Wrote %s\n", partial_path.c_str());
+
+                continue;
+            }
+
+            printf("Baking %s: page %u of %u, %dx%d atlas, %d bake points, %d spp, %d bounces, %d scenarios\n", scene_path.c_str(), p + 1, baker.m_page_count, size, size, int(baker.m_bake_points.size()), spp, bounces, int(scenarios.size()));
+
+            auto bake_start = std::chrono::high_resolution_clock::now();
+
+            std::vector<std::vector<glm::vec4>> framebuffers;
+            std::vector<std::string>            partials = merge_paths;
+
+            if (workers > 0 && !run_workers(argc, argv, workers, worker_threads, p, unwrap_cache_path, output_path, page_suffix, partials))
+                return HEADLESS_EXIT_BAKE_FAILED;
+
+            if (!partials.empty())
+            {
+                baker.m_light_direction = light_scenarios[0].light_direction;
+                baker.clear_lightmap();
+
+                for (const std::string& partial : partials)
+                {
+                    if (!baker.merge_bake_partial(partial))
+                    {
+                        fprintf(stderr, "Failed to merge partial bake: %s\n", partial.c_str());
+                        return HEADLESS_EXIT_BAKE_FAILED;
+                    }
+
+                    printf("Merged %s\n", partial.c_str());
+
+                    // Partials of local workers are only spooled for the merge.
+                    if (workers > 0)
+                        remove(partial.c_str());
+                }
+
+                baker.scatter_framebuffer();
+                framebuffers.push_back(baker.m_framebuffer);
+            }
+            else if (light_scenarios.size() == 1)
+            {
+                baker.m_light_direction = light_scenarios[0].light_direction;
+
+                bool cached = !page_cache.empty() && baker.load_bake_cache(page_cache);
+
+                if (cached)
+                    printf(baker.has_pending_points() ? "Resuming from checkpoint %s\n" : "Loaded %s\n", page_cache.c_str());
+
+                // A checkpoint is always finished, a complete cache only gets more samples when asked to.
+                if (!cached || resume || baker.has_pending_points())
+                {
+                    baker.bake(cached);
+                    baker.wait();
+                    baker.scatter_framebuffer();
+
+                    if (!page_cache.empty() && !baker.save_bake_cache(page_cache))
+                    {
+                        fprintf(stderr, "Failed to write bake cache: %s\n", page_cache.c_str());
+                        return HEADLESS_EXIT_WRITE_FAILED;
+                    }
+                }
+
+                framebuffers.push_back(baker.m_framebuffer);
+            }
+            else
+                baker.bake_scenarios(light_scenarios, framebuffers);
+
+            auto bake_end = std::chrono::high_resolution_clock::now();
+
+            printf("Baked in %.2f seconds\n", std::chrono::duration<double>(bake_end - bake_start).count());
+
+            std::vector<glm::vec4> dilated(size * size);
+
+            for (uint32_t i = 0; i < framebuffers.size(); i++)
+            {
+                std::string path = lightmap_output_path(output_path, page_suffix, i, uint32_t(framebuffers.size()));
+
+                if (denoise && !baker.denoise(framebuffers[i]))
+                    return HEADLESS_EXIT_BAKE_FAILED;
+
+                {
+                    ScopedPhaseTimer timer(baker.m_stats, BAKE_PHASE_DILATE);
+                    dilate_lightmap(framebuffers[i].data(), dilated.data(), size);
+                }
+
+                ScopedPhaseTimer timer(baker.m_stats, BAKE_PHASE_WRITE);
+
+                if (!write_lightmap_hdr(path, dilated.data(), size))
+                {
+                    fprintf(stderr, "Failed to write lightmap: %s\n", path.c_str());
+                    return HEADLESS_EXIT_WRITE_FAILED;
+                }
+
+                printf("Wrote %s\n", path.c_str());
+            }
+        }
+
+        if (spool_unwrap_cache)
+            remove(unwrap_cache_path.c_str());
+
+        if (!report_path.empty())
+        {
+            if (!baker.write_bake_report(report_path, scene_path))
+            {
+                fprintf(stderr, "Failed to write bake report: %s\n", report_path.c_str());
+                return HEADLESS_EXIT_WRITE_FAILED;
+            }
+
+            printf("Wrote %s\n", report_path.c_str());
+        }
+    }
+    catch (const std::exception& e)
+    {
+        fprintf(stderr, "Bake failed: %s\n", e.what());
+        return HEADLESS_EXIT_BAKE_FAILED;
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+
+    printf("Finished in %.2f seconds\n", std::chrono::duration<double>(end - start).count());
+
+    return HEADLESS_EXIT_SUCCESS;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,15 @@
+#pragma once
+
+// Returns true if the command line asks for a headless bake.
+bool is_headless_bake(int argc, const char* argv[]);
+
+// Runs unwrap -> Embree build -> bake -> denoise -> dilate -> write without creating a window or GL context and returns the
+// process exit code.
+//
+// Usage: PrecomputedGI --bake <scene.obj|scene.lmscene|scene.lmdesc> [--size <texels>] [--spp <samples>] [--bounces <bounces>] [--adaptive <max samples>]
+//                       [--threshold <relative error>] [--scalar] [--spatial-order] [--no-sky-sampling] [--denoise]
+//                       [--scenario <x,y,z[,turbidity]>]... [--cache <bake.cache> [--resume] [--checkpoint <seconds>]]
+//                       [--unwrap-cache <unwrap.cache>] [--texels-per-unit <texels>] [--page <index>] [--stream <tile texels>]
+//                       [--workers <count> | --jobs <count> --job <index> --partial <job.partial> | --merge <job.partial>...]
+//                       [--threads <count>] [--write-scene <scene.lmscene>] [--report <report.json>] [--output <lightmap.hdr>]
+int headless_bake(int argc, const char* argv[]);
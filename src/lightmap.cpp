@@ -0,0 +1,158 @@
+#include "lightmap.h"
+#include <OpenImageDenoise/oidn.hpp>
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+
+const glm::ivec2 DilateOffsets[8] = {
+    glm::ivec2(-1, -1),
+    glm::ivec2(0, -1),
+    glm::ivec2(1, -1),
+    glm::ivec2(-1, 0),
+    glm::ivec2(1, 0),
+    glm::ivec2(-1, 1),
+    glm::ivec2(0, 1),
+    glm::ivec2(1, 1)
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void dilate_lightmap(const glm::vec4* src, glm::vec4* dst, int size)
+{
+    for (int y = 0; y < size; y++)
+    {
+        for (int x = 0; x < size; x++)
+        {
+            glm::vec4 c = src[size * y + x];
+
+            for (int i = 0; i < 8 && c.a <= 0.0f; i++)
+            {
+                int nx = std::min(std::max(x + DilateOffsets[i].x, 0), size - 1);
+                int ny = std::min(std::max(y + DilateOffsets[i].y, 0), size - 1);
+
+                c = src[size * ny + nx];
+            }
+
+            dst[size * y + x] = c;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool denoise_lightmap(glm::vec4* data, const glm::vec3* albedo, const glm::vec3* normal, int size)
+{
+    std::vector<glm::vec3> output(size * size);
+
+    oidn::DeviceRef device = oidn::newDevice(oidn::DeviceType::CPU);
+    device.commit();
+
+    // The color image is read straight out of the RGBA framebuffer by using the vec4 size as the pixel stride.
+    oidn::FilterRef filter = device.newFilter("RT");
+    filter.setImage("color", data, oidn::Format::Float3, size, size, 0, sizeof(glm::vec4));
+    filter.setImage("albedo", (void*)albedo, oidn::Format::Float3, size, size);
+    filter.setImage("normal", (void*)normal, oidn::Format::Float3, size, size);
+    filter.setImage("output", output.data(), oidn::Format::Float3, size, size);
+    filter.set("hdr", true);
+    filter.commit();
+    filter.execute();
+
+    const char* message = nullptr;
+
+    if (device.getError(message) != oidn::Error::None)
+    {
+        fprintf(stderr, "Failed to denoise lightmap: %s\n", message);
+        return false;
+    }
+
+    for (int i = 0; i < size * size; i++)
+    {
+        if (data[i].a > 0.0f)
+            data[i] = glm::vec4(output[i], data[i].a);
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool write_lightmap_hdr(const std::string& path, const glm::vec4* data, int size)
+{
+    return write_lightmap_hdr(path, size, [&](int y, glm::vec4* row) {
+        std::copy(data + size * y, data + size * (y + 1), row);
+    });
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool write_lightmap_hdr(const std::string& path, int size, const std::function<void(int, glm::vec4*)>& read_row)
+{
+    FILE* f = fopen(path.c_str(), "wb");
+
+    if (!f)
+        return false;
+
+    fprintf(f, "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y %d +X %d\n", size, size);
+
+    std::vector<glm::vec4> row(size);
+    std::vector<uint8_t>   scanline(size * 4);
+
+    for (int y = 0; y < size; y++)
+    {
+        read_row(y, row.data());
+
+        for (int x = 0; x < size; x++)
+        {
+            const glm::vec4& c = row[x];
+            float            v = std::max(c.r, std::max(c.g, c.b));
+            uint8_t*         p = &scanline[x * 4];
+
+            if (v < 1e-32f)
+                p[0] = p[1] = p[2] = p[3] = 0;
+            else
+            {
+                int   e;
+                float m = frexpf(v, &e) * 256.0f / v;
+
+                p[0] = uint8_t(std::max(c.r, 0.0f) * m);
+                p[1] = uint8_t(std::max(c.g, 0.0f) * m);
+                p[2] = uint8_t(std::max(c.b, 0.0f) * m);
+                p[3] = uint8_t(e + 128);
+            }
+        }
+
+        if (size < 8 || size > 0x7fff)
+            fwrite(scanline.data(), 1, scanline.size(), f);
+        else
+        {
+            // New style scanline: the 2, 2 marker and width, then each channel separately as literal runs of at most 128
+            // bytes. Readers would otherwise misinterpret a flat scanline that happens to start with the marker bytes.
+            uint8_t header[4] = { 2, 2, uint8_t(size >> 8), uint8_t(size & 0xff) };
+            fwrite(header, 1, 4, f);
+
+            for (int c = 0; c < 4; c++)
+            {
+                for (int x = 0; x < size; x += 128)
+                {
+                    uint8_t run[129];
+                    int     count = std::min(size - x, 128);
+
+                    run[0] = uint8_t(count);
+
+                    for (int i = 0; i < count; i++)
+                        run[i + 1] = scanline[(x + i) * 4 + c];
+
+                    fwrite(run, 1, count + 1, f);
+                }
+            }
+        }
+    }
+
+    bool status = ferror(f) == 0;
+    fclose(f);
+
+    return status;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
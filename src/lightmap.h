@@ -0,0 +1,77 @@
+#pragma once
+
+#include <ogl.h>
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct LightmapSubMesh
+{
+    uint32_t  index_count;
+    uint32_t  base_vertex;
+    uint32_t  base_index;
+    glm::vec3 max_extents;
+    glm::vec3 min_extents;
+    glm::vec3 color;
+};
+
+struct LightmapVertex
+{
+    glm::vec3 position;
+    glm::vec2 uv;
+    glm::vec2 lightmap_uv;
+    glm::vec3 normal;
+    glm::vec3 tangent;
+    glm::vec3 bitangent;
+};
+
+// Bake points as one stream per attribute, with an entry for every texel that is baked and nothing for the texels in
+// between. Texels are atlas texel indices (size * y + x).
+struct BakePoints
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> directions;
+    std::vector<uint32_t>  texels;
+
+    uint32_t size() const { return uint32_t(texels.size()); }
+    bool     empty() const { return texels.empty(); }
+
+    void clear()
+    {
+        positions.clear();
+        directions.clear();
+        texels.clear();
+    }
+
+    void push_back(const glm::vec3& position, const glm::vec3& direction, uint32_t texel)
+    {
+        positions.push_back(position);
+        directions.push_back(direction);
+        texels.push_back(texel);
+    }
+
+    void append(const BakePoints& other)
+    {
+        positions.insert(positions.end(), other.positions.begin(), other.positions.end());
+        directions.insert(directions.end(), other.directions.begin(), other.directions.end());
+        texels.insert(texels.end(), other.texels.begin(), other.texels.end());
+    }
+};
+
+// Neighbour order used when dilating lightmap data, in texel units.
+extern const glm::ivec2 DilateOffsets[8];
+
+// Fills texels whose alpha is zero with the first neighbour whose alpha is not, exactly like the old dilate_fs.glsl pass.
+void dilate_lightmap(const glm::vec4* src, glm::vec4* dst, int size);
+
+// Denoises the RGB channels of a size x size HDR lightmap in place with Open Image Denoise on the CPU, guided by
+// per-texel albedo and normal buffers. Texels with zero alpha are left untouched so that they can still be dilated.
+bool denoise_lightmap(glm::vec4* data, const glm::vec3* albedo, const glm::vec3* normal, int size);
+
+// Writes the RGB channels of a size x size float image as a Radiance HDR file, starting with row zero.
+bool write_lightmap_hdr(const std::string& path, const glm::vec4* data, int size);
+
+// Same as above, but read_row fills in one row at a time just before it is encoded, so the image never has to be in memory
+// as a whole.
+bool write_lightmap_hdr(const std::string& path, int size, const std::function<void(int, glm::vec4*)>& read_row);
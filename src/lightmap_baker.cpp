@@ -0,0 +1,2043 @@
+#define _USE_MATH_DEFINES
+#include "lightmap_baker.h"
+#include "bake_cache.h"
+#include "hash.h"
+#include "parallel.h"
+#include "rasterizer.h"
+#include "random.h"
+#include "skybox.h"
+#include "tiled_lightmap.h"
+#include "unwrap_cache.h"
+#include <math.h>
+#include <assert.h>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <stdio.h>
+#include <thread>
+#include <xatlas.h>
+#include <logger.h>
+
+#undef min
+#undef max
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static bool is_nan(glm::vec3 v)
+{
+    glm::bvec3 b = glm::isnan(v);
+    return b.x || b.y || b.z;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Quoted JSON string, for file paths that may contain backslashes.
+static std::string json_string(const std::string& str)
+{
+    std::string quoted = "\"";
+
+    for (char c : str)
+    {
+        if (c == '"' || c == '\\')
+            quoted += '\\';
+
+        quoted += c;
+    }
+
+    return quoted + "\"";
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static glm::mat3 make_rotation_matrix(glm::vec3 z)
+{
+    const glm::vec3 ref = glm::abs(glm::dot(z, glm::vec3(0, 1, 0))) > 0.99f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+
+    const glm::vec3 x = glm::normalize(glm::cross(ref, z));
+    const glm::vec3 y = glm::cross(z, x);
+
+    assert(!is_nan(x));
+    assert(!is_nan(y));
+    assert(!is_nan(z));
+
+    return { x, y, z };
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static glm::vec3 diffuse_lambert(glm::vec3 albedo)
+{
+    return albedo;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static float luminance(glm::vec3 color)
+{
+    return glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Power heuristic weight of a sample drawn with pdf_a when pdf_b could also have produced it.
+static float mis_weight(float pdf_a, float pdf_b)
+{
+    return (pdf_a * pdf_a) / glm::max(pdf_a * pdf_a + pdf_b * pdf_b, 1e-20f);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static bool is_triangle_back_facing(glm::vec3 n, glm::vec3 d)
+{
+    return glm::dot(n, d) > 0.0f;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void create_ray(glm::vec3 direction, glm::vec3 position, RTCRayHit& rayhit)
+{
+    rayhit.ray.dir_x = direction.x;
+    rayhit.ray.dir_y = direction.y;
+    rayhit.ray.dir_z = direction.z;
+
+    rayhit.ray.org_x = position.x;
+    rayhit.ray.org_y = position.y;
+    rayhit.ray.org_z = position.z;
+
+    rayhit.ray.tnear     = 0;
+    rayhit.ray.tfar      = INFINITY;
+    rayhit.ray.mask      = -1;
+    rayhit.ray.flags     = 0;
+    rayhit.hit.geomID    = RTC_INVALID_GEOMETRY_ID;
+    rayhit.hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Bakes on num_threads worker threads, or on one per hardware thread if it is zero.
+LightmapBaker::LightmapBaker(uint32_t num_threads) :
+    m_thread_pool(num_threads > 0 ? num_threads : std::thread::hardware_concurrency())
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+LightmapBaker::~LightmapBaker()
+{
+    stop_checkpoints();
+
+    if (m_embree_scene)
+        rtcReleaseScene(m_embree_scene);
+
+    for (RTCScene mesh_scene : m_embree_mesh_scenes)
+    {
+        if (mesh_scene != m_embree_scene)
+            rtcReleaseScene(mesh_scene);
+    }
+
+    if (m_embree_device)
+        rtcReleaseDevice(m_embree_device);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool LightmapBaker::initialize(const Scene& scene, Skybox* skybox)
+{
+    InstancedScene instanced_scene;
+
+    instanced_scene.m_meshes.push_back(&scene);
+    instanced_scene.m_instances.push_back({ 0, glm::mat4(1.0f) });
+
+    return initialize(instanced_scene, skybox);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool LightmapBaker::initialize(const InstancedScene& scene, Skybox* skybox)
+{
+    m_skybox     = skybox;
+    m_scene_hash = hash_scene(scene);
+
+    {
+        ScopedPhaseTimer timer(m_stats, BAKE_PHASE_UNWRAP);
+
+        if (m_unwrap_cache_path.empty() || !read_unwrap_cache(m_unwrap_cache_path, unwrap_cache_key(), m_vertices, m_indices, m_submeshes, m_vertex_pages, m_page_count))
+        {
+            if (!lightmap_uv_unwrap(scene))
+                return false;
+
+            if (!m_unwrap_cache_path.empty() && !write_unwrap_cache(m_unwrap_cache_path, unwrap_cache_key(), m_vertices, m_indices, m_submeshes, m_vertex_pages, m_page_count))
+                DW_LOG_ERROR("Failed to write unwrap cache");
+        }
+    }
+
+    {
+        ScopedPhaseTimer timer(m_stats, BAKE_PHASE_EMBREE_BUILD);
+
+        if (!initialize_embree(scene))
+            return false;
+    }
+
+    set_region(glm::ivec2(0), glm::ivec2(m_stream_tile_size > 0 ? std::min(m_stream_tile_size, m_lightmap_size) : m_lightmap_size));
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Narrows the framebuffer and the bake points down to a rectangle of the atlas. Bake points have to be initialized
+// again afterwards, as only those inside the region can be baked.
+void LightmapBaker::set_region(glm::ivec2 origin, glm::ivec2 extent)
+{
+    m_region_origin = origin;
+    m_region_extent = extent;
+
+    m_framebuffer.resize(extent.x * extent.y);
+    m_framebuffer.shrink_to_fit();
+
+    m_bake_points.clear();
+    m_accumulation.clear();
+    m_sample_counts.clear();
+    m_gutter.clear();
+    m_pending.clear();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Atlas texels seed the random numbers of their paths, so a texel bakes the same whichever region it is part of. This
+// maps one to its entry in the region framebuffer.
+uint32_t LightmapBaker::region_texel(uint32_t texel)
+{
+    int x = int(texel % m_lightmap_size) - m_region_origin.x;
+    int y = int(texel / m_lightmap_size) - m_region_origin.y;
+
+    return m_region_extent.x * y + x;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void LightmapBaker::initialize_bake_points(bool conservative)
+{
+    ScopedPhaseTimer timer(m_stats, BAKE_PHASE_BAKE_POINTS);
+
+    m_conservative = conservative;
+
+    // The accumulation of texels that are still baked is carried over to their new bake points, so that a bake can be
+    // resumed after changing the bake order or rasterization mode. Old points are found through a region-sized index,
+    // a fraction of the size of a dense accumulation buffer.
+    std::vector<uint32_t> previous(m_accumulation.empty() ? 0 : m_framebuffer.size(), UINT32_MAX);
+
+    if (!previous.empty())
+    {
+        for (uint32_t i = 0; i < m_bake_points.size(); i++)
+            previous[region_texel(m_bake_points.texels[i])] = i;
+    }
+
+    rasterize_bake_points(m_thread_pool,
+                          m_vertices,
+                          m_indices,
+                          m_submeshes,
+                          m_vertex_pages,
+                          m_page,
+                          m_lightmap_size,
+                          m_region_origin,
+                          m_region_origin + m_region_extent,
+                          conservative,
+                          m_bake_points);
+
+    build_bake_tiles();
+
+    std::vector<glm::vec4> accumulation(m_bake_points.size(), glm::vec4(0.0f));
+    std::vector<uint32_t>  sample_counts(m_bake_points.size(), 0);
+    std::vector<uint8_t>   gutter(m_bake_points.size(), 0);
+    std::vector<uint8_t>   pending(m_bake_points.size(), 0);
+
+    for (uint32_t i = 0; !previous.empty() && i < m_bake_points.size(); i++)
+    {
+        uint32_t point = previous[region_texel(m_bake_points.texels[i])];
+
+        if (point != UINT32_MAX)
+        {
+            accumulation[i]  = m_accumulation[point];
+            sample_counts[i] = m_sample_counts[point];
+            gutter[i]        = m_gutter[point];
+            pending[i]       = m_pending[point];
+        }
+    }
+
+    m_accumulation  = std::move(accumulation);
+    m_sample_counts = std::move(sample_counts);
+    m_gutter        = std::move(gutter);
+    m_pending       = std::move(pending);
+
+    // Recorded paths refer to bake points by index.
+    m_relight_tiles.clear();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Groups the bake points into the tiles which the bake tasks pull one at a time. By default a tile is a square of
+// 32x32 lightmap texels (eight cache lines of the framebuffer wide), so tasks never write to each other's framebuffer
+// rows. With m_spatial_order the points are instead sorted along a Morton curve through the scene by position and
+// normal, so consecutive paths start close together and facing the same way, and a tile is a run of that order.
+void LightmapBaker::build_bake_tiles()
+{
+    m_bake_tiles.clear();
+
+    const uint32_t num_points = m_bake_points.size();
+
+    std::vector<uint32_t> order(num_points);
+
+    for (uint32_t i = 0; i < num_points; i++)
+        order[i] = i;
+
+    if (m_spatial_order)
+    {
+        auto spatial_key = [this](uint32_t point) {
+            const glm::vec3& direction = m_bake_points.directions[point];
+            uint64_t         octant    = (direction.x < 0.0f ? 4 : 0) | (direction.y < 0.0f ? 2 : 0) | (direction.z < 0.0f ? 1 : 0);
+            return (morton_code(m_bake_points.positions[point], m_scene_min, m_scene_max) << 3) | octant;
+        };
+
+        std::vector<std::pair<uint64_t, uint32_t>> keyed(num_points);
+
+        for (uint32_t i = 0; i < num_points; i++)
+            keyed[i] = std::make_pair(spatial_key(i), i);
+
+        std::stable_sort(keyed.begin(), keyed.end(), [](const std::pair<uint64_t, uint32_t>& a, const std::pair<uint64_t, uint32_t>& b) {
+            return a.first < b.first;
+        });
+
+        for (uint32_t i = 0; i < num_points; i++)
+        {
+            order[i] = keyed[i].second;
+
+            if (i % (BAKE_TILE_SIZE * BAKE_TILE_SIZE) == 0)
+                m_bake_tiles.push_back(i);
+        }
+    }
+    else
+    {
+        const uint32_t tiles_per_row = (m_lightmap_size + BAKE_TILE_SIZE - 1) / BAKE_TILE_SIZE;
+
+        auto tile_index = [this, tiles_per_row](uint32_t point) {
+            uint32_t texel = m_bake_points.texels[point];
+            return (texel / m_lightmap_size / BAKE_TILE_SIZE) * tiles_per_row + (texel % m_lightmap_size) / BAKE_TILE_SIZE;
+        };
+
+        // Stable, so the points within a tile stay in raster order.
+        std::stable_sort(order.begin(), order.end(), [&tile_index](uint32_t a, uint32_t b) {
+            return tile_index(a) < tile_index(b);
+        });
+
+        for (uint32_t i = 0; i < num_points; i++)
+        {
+            if (i == 0 || tile_index(order[i]) != tile_index(order[i - 1]))
+                m_bake_tiles.push_back(i);
+        }
+    }
+
+    // Each stream is permuted on its own, so a tile reads contiguous runs of every attribute.
+    BakePoints sorted;
+
+    sorted.positions.resize(num_points);
+    sorted.directions.resize(num_points);
+    sorted.texels.resize(num_points);
+
+    for (uint32_t i = 0; i < num_points; i++)
+    {
+        sorted.positions[i]  = m_bake_points.positions[order[i]];
+        sorted.directions[i] = m_bake_points.directions[order[i]];
+        sorted.texels[i]     = m_bake_points.texels[order[i]];
+    }
+
+    m_bake_points = std::move(sorted);
+
+    m_bake_tiles.push_back(num_points);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Every instance is unwrapped on its own with world space positions, so each gets its own region of the atlas at a
+// texel density that accounts for its scale.
+bool LightmapBaker::lightmap_uv_unwrap(const InstancedScene& scene)
+{
+    struct UnwrapItem
+    {
+        uint32_t instance;
+        uint32_t submesh;
+    };
+
+    std::vector<UnwrapItem> items;
+
+    for (uint32_t instance_idx = 0; instance_idx < scene.m_instances.size(); instance_idx++)
+    {
+        for (uint32_t submesh_idx = 0; submesh_idx < scene.m_meshes[scene.m_instances[instance_idx].mesh]->m_submeshes.size(); submesh_idx++)
+            items.push_back({ instance_idx, submesh_idx });
+    }
+
+    const uint32_t num_items = uint32_t(items.size());
+
+    // Every submesh is handed to xatlas with only the vertices it references, remapped into a compact local array, so
+    // the work per mesh scales with the submesh rather than with the whole scene. The remapping is independent per
+    // submesh and runs on the thread pool.
+    std::vector<std::vector<glm::vec3>> local_positions(num_items);
+    std::vector<std::vector<glm::vec3>> local_normals(num_items);
+    std::vector<std::vector<glm::vec2>> local_tex_coords(num_items);
+    std::vector<std::vector<uint32_t>>  local_indices(num_items);
+    std::vector<std::vector<uint32_t>>  local_to_scene(num_items);
+
+    parallel_for(m_thread_pool, num_items, [&](uint32_t band, uint32_t start, uint32_t end) {
+        std::vector<uint32_t> remap;
+
+        for (uint32_t item_idx = start; item_idx < end; item_idx++)
+        {
+            const SceneInstance& instance = scene.m_instances[items[item_idx].instance];
+            const Scene&         mesh     = *scene.m_meshes[instance.mesh];
+            const SceneSubMesh&  submesh  = mesh.m_submeshes[items[item_idx].submesh];
+            const uint32_t*      indices  = mesh.m_indices.data() + submesh.base_index;
+            const glm::mat3      normal   = glm::transpose(glm::inverse(glm::mat3(instance.transform)));
+
+            if (submesh.index_count == 0)
+                continue;
+
+            uint32_t min_index = UINT32_MAX;
+            uint32_t max_index = 0;
+
+            for (uint32_t i = 0; i < submesh.index_count; i++)
+            {
+                min_index = std::min(min_index, indices[i]);
+                max_index = std::max(max_index, indices[i]);
+            }
+
+            remap.assign(max_index - min_index + 1, UINT32_MAX);
+
+            local_indices[item_idx].resize(submesh.index_count);
+
+            for (uint32_t i = 0; i < submesh.index_count; i++)
+            {
+                uint32_t& local = remap[indices[i] - min_index];
+
+                if (local == UINT32_MAX)
+                {
+                    const SceneVertex& v = mesh.m_vertices[submesh.base_vertex + indices[i]];
+
+                    local = uint32_t(local_to_scene[item_idx].size());
+
+                    local_to_scene[item_idx].push_back(submesh.base_vertex + indices[i]);
+                    local_positions[item_idx].push_back(glm::vec3(instance.transform * glm::vec4(v.position, 1.0f)));
+                    local_normals[item_idx].push_back(glm::normalize(normal * v.normal));
+                    local_tex_coords[item_idx].push_back(v.tex_coord);
+                }
+
+                local_indices[item_idx][i] = local;
+            }
+        }
+    });
+
+    xatlas::Atlas* atlas = xatlas::Create();
+
+    for (uint32_t item_idx = 0; item_idx < num_items; item_idx++)
+    {
+        xatlas::MeshDecl mesh_decl;
+
+        mesh_decl.vertexCount          = uint32_t(local_positions[item_idx].size());
+        mesh_decl.vertexPositionStride = sizeof(glm::vec3);
+        mesh_decl.vertexPositionData   = local_positions[item_idx].data();
+        mesh_decl.vertexNormalStride   = sizeof(glm::vec3);
+        mesh_decl.vertexNormalData     = local_normals[item_idx].data();
+        mesh_decl.vertexUvStride       = sizeof(glm::vec2);
+        mesh_decl.vertexUvData         = local_tex_coords[item_idx].data();
+        mesh_decl.indexCount           = uint32_t(local_indices[item_idx].size());
+        mesh_decl.indexData            = local_indices[item_idx].data();
+        mesh_decl.indexOffset          = 0;
+        mesh_decl.indexFormat          = xatlas::IndexFormat::UInt32;
+
+        xatlas::AddMeshError::Enum error = xatlas::AddMesh(atlas, mesh_decl);
+
+        if (error != xatlas::AddMeshError::Success)
+        {
+            xatlas::Destroy(atlas);
+            DW_LOG_ERROR("Failed to add UV mesh to Lightmap Atlas");
+            return false;
+        }
+    }
+
+    xatlas::ComputeCharts(atlas);
+    xatlas::ParameterizeCharts(atlas);
+
+    xatlas::PackOptions pack_options;
+
+    pack_options.padding       = LIGHTMAP_CHART_PADDING;
+    pack_options.resolution    = m_lightmap_size;
+    pack_options.texelsPerUnit = m_texels_per_unit;
+
+    xatlas::PackCharts(atlas, pack_options);
+
+    m_page_count = std::max(atlas->atlasCount, 1u);
+
+    m_submeshes.resize(atlas->meshCount);
+
+    uint32_t index_count  = 0;
+    uint32_t vertex_count = 0;
+
+    for (uint32_t mesh_idx = 0; mesh_idx < atlas->meshCount; mesh_idx++)
+    {
+        const SceneInstance& instance      = scene.m_instances[items[mesh_idx].instance];
+        const SceneSubMesh&  scene_submesh = scene.m_meshes[instance.mesh]->m_submeshes[items[mesh_idx].submesh];
+        LightmapSubMesh&     sub           = m_submeshes[mesh_idx];
+
+        sub.color       = scene_submesh.albedo;
+        sub.index_count = scene_submesh.index_count;
+        sub.base_index  = index_count;
+        sub.base_vertex = vertex_count;
+        sub.max_extents = glm::vec3(-INFINITY);
+        sub.min_extents = glm::vec3(INFINITY);
+
+        // World space bounds of the transformed local bounds.
+        for (uint32_t corner = 0; corner < 8; corner++)
+        {
+            glm::vec3 p = glm::vec3(corner & 1 ? scene_submesh.max_extents.x : scene_submesh.min_extents.x,
+                                    corner & 2 ? scene_submesh.max_extents.y : scene_submesh.min_extents.y,
+                                    corner & 4 ? scene_submesh.max_extents.z : scene_submesh.min_extents.z);
+
+            p = glm::vec3(instance.transform * glm::vec4(p, 1.0f));
+
+            sub.max_extents = glm::max(sub.max_extents, p);
+            sub.min_extents = glm::min(sub.min_extents, p);
+        }
+
+        index_count += atlas->meshes[mesh_idx].indexCount;
+        vertex_count += atlas->meshes[mesh_idx].vertexCount;
+    }
+
+    // With the offsets known up front every submesh writes its own range of the pre-sized buffers in parallel.
+    m_vertices.resize(vertex_count);
+    m_vertex_pages.resize(vertex_count);
+    m_indices.resize(index_count);
+
+    parallel_for(m_thread_pool, atlas->meshCount, [&](uint32_t band, uint32_t start, uint32_t end) {
+        for (uint32_t mesh_idx = start; mesh_idx < end; mesh_idx++)
+        {
+            const xatlas::Mesh&    mesh     = atlas->meshes[mesh_idx];
+            const LightmapSubMesh& sub      = m_submeshes[mesh_idx];
+            const SceneInstance&   instance = scene.m_instances[items[mesh_idx].instance];
+            const Scene&           src_mesh = *scene.m_meshes[instance.mesh];
+            const glm::mat3        model    = glm::mat3(instance.transform);
+            const glm::mat3        normal   = glm::transpose(glm::inverse(model));
+
+            for (uint32_t i = 0; i < mesh.vertexCount; i++)
+            {
+                const SceneVertex& src = src_mesh.m_vertices[local_to_scene[mesh_idx][mesh.vertexArray[i].xref]];
+                LightmapVertex&    v   = m_vertices[sub.base_vertex + i];
+
+                v.position    = glm::vec3(instance.transform * glm::vec4(src.position, 1.0f));
+                v.uv          = src.tex_coord;
+                v.normal      = glm::normalize(normal * src.normal);
+                v.tangent     = model * src.tangent;
+                v.bitangent   = model * src.bitangent;
+                v.lightmap_uv = glm::vec2(mesh.vertexArray[i].uv[0] / (atlas->width - 1), mesh.vertexArray[i].uv[1] / (atlas->height - 1));
+
+                // Vertices of charts that could not be packed have no page and are left out of every bake.
+                m_vertex_pages[sub.base_vertex + i] = mesh.vertexArray[i].atlasIndex < 0 ? UINT32_MAX : uint32_t(mesh.vertexArray[i].atlasIndex);
+            }
+
+            std::copy(mesh.indexArray, mesh.indexArray + mesh.indexCount, m_indices.begin() + sub.base_index);
+        }
+    });
+
+    xatlas::Destroy(atlas);
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// The unwrap only depends on the scene and on the pack options.
+uint64_t LightmapBaker::unwrap_cache_key()
+{
+    uint64_t key = m_scene_hash;
+
+    key = hash_value(m_lightmap_size, key);
+    key = hash_value(uint32_t(LIGHTMAP_CHART_PADDING), key);
+    key = hash_value(m_texels_per_unit, key);
+
+    return key;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool LightmapBaker::initialize_embree(const InstancedScene& scene)
+{
+    m_embree_device = rtcNewDevice(nullptr);
+
+    RTCError embree_error = rtcGetDeviceError(m_embree_device);
+
+    if (embree_error == RTC_ERROR_UNSUPPORTED_CPU)
+        throw std::runtime_error("Your CPU does not meet the minimum requirements for embree");
+    else if (embree_error != RTC_ERROR_NONE)
+        throw std::runtime_error("Failed to initialize embree!");
+
+    // A single untransformed instance is traced directly, without the extra level of an instance.
+    const bool flatten = scene.m_instances.size() == 1 && scene.m_instances[0].transform == glm::mat4(1.0f);
+
+    m_embree_mesh_scenes.clear();
+    m_mesh_first_geometry.clear();
+    m_geometry_first_triangle.clear();
+    m_triangle_colors.clear();
+    m_scene_mappings.clear();
+
+    // One Embree scene per unique mesh, with one triangle geometry per submesh and the submesh index as geometry ID.
+    for (const Scene* mesh : scene.m_meshes)
+    {
+        RTCScene mesh_scene = rtcNewScene(m_embree_device);
+
+        rtcSetSceneFlags(mesh_scene, RTC_SCENE_FLAG_ROBUST);
+
+        m_mesh_first_geometry.push_back(uint32_t(m_geometry_first_triangle.size()));
+
+        // A mapped scene file outlives the scene it was loaded into, so Embree can read the vertices and
+        // submesh-relative indices straight from it. The position is the first member of SceneVertex, which also keeps
+        // the 16 byte read of the last vertex inside the buffer.
+        if (mesh->m_mapping)
+            m_scene_mappings.push_back(mesh->m_mapping);
+
+        for (uint32_t submesh_idx = 0; submesh_idx < mesh->m_submeshes.size(); submesh_idx++)
+        {
+            const SceneSubMesh& submesh       = mesh->m_submeshes[submesh_idx];
+            const uint32_t*     src_indices   = mesh->m_indices.data() + submesh.base_index;
+            const uint32_t      num_triangles = submesh.index_count / 3;
+
+            uint32_t num_vertices = 0;
+
+            for (uint32_t j = 0; j < submesh.index_count; j++)
+                num_vertices = std::max(num_vertices, src_indices[j] + 1);
+
+            RTCGeometry geometry = rtcNewGeometry(m_embree_device, RTC_GEOMETRY_TYPE_TRIANGLE);
+
+            if (mesh->m_mapping)
+            {
+                rtcSetSharedGeometryBuffer(geometry, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT3, mesh->m_vertices.data(), submesh.base_vertex * sizeof(SceneVertex), sizeof(SceneVertex), num_vertices);
+                rtcSetSharedGeometryBuffer(geometry, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT3, mesh->m_indices.data(), submesh.base_index * sizeof(uint32_t), 3 * sizeof(uint32_t), num_triangles);
+            }
+            else
+            {
+                glm::vec3* vertices = (glm::vec3*)rtcSetNewGeometryBuffer(geometry, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT3, sizeof(glm::vec3), num_vertices);
+                uint32_t*  indices  = (uint32_t*)rtcSetNewGeometryBuffer(geometry, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT3, 3 * sizeof(uint32_t), num_triangles);
+
+                for (uint32_t j = 0; j < num_vertices; j++)
+                    vertices[j] = mesh->m_vertices[submesh.base_vertex + j].position;
+
+                std::copy(src_indices, src_indices + num_triangles * 3, indices);
+            }
+
+            rtcCommitGeometry(geometry);
+            rtcAttachGeometryByID(mesh_scene, geometry, submesh_idx);
+            rtcReleaseGeometry(geometry);
+
+            m_geometry_first_triangle.push_back(uint32_t(m_triangle_colors.size()));
+            m_triangle_colors.insert(m_triangle_colors.end(), num_triangles, submesh.albedo);
+        }
+
+        rtcCommitScene(mesh_scene);
+
+        m_embree_mesh_scenes.push_back(mesh_scene);
+    }
+
+    m_instance_meshes.clear();
+    m_instance_normal_matrices.clear();
+
+    for (const SceneInstance& instance : scene.m_instances)
+    {
+        m_instance_meshes.push_back(instance.mesh);
+        m_instance_normal_matrices.push_back(glm::transpose(glm::inverse(glm::mat3(instance.transform))));
+    }
+
+    if (flatten)
+        m_embree_scene = m_embree_mesh_scenes[scene.m_instances[0].mesh];
+    else
+    {
+        m_embree_scene = rtcNewScene(m_embree_device);
+
+        rtcSetSceneFlags(m_embree_scene, RTC_SCENE_FLAG_ROBUST);
+
+        for (uint32_t instance_idx = 0; instance_idx < scene.m_instances.size(); instance_idx++)
+        {
+            const SceneInstance& instance = scene.m_instances[instance_idx];
+            RTCGeometry          geometry = rtcNewGeometry(m_embree_device, RTC_GEOMETRY_TYPE_INSTANCE);
+
+            rtcSetGeometryInstancedScene(geometry, m_embree_mesh_scenes[instance.mesh]);
+            rtcSetGeometryTransform(geometry, 0, RTC_FORMAT_FLOAT4X4_COLUMN_MAJOR, &instance.transform[0][0]);
+            rtcCommitGeometry(geometry);
+            rtcAttachGeometryByID(m_embree_scene, geometry, instance_idx);
+            rtcReleaseGeometry(geometry);
+        }
+
+        rtcCommitScene(m_embree_scene);
+    }
+
+    RTCBounds bounds;
+    rtcGetSceneBounds(m_embree_scene, &bounds);
+
+    m_scene_min = glm::vec3(bounds.lower_x, bounds.lower_y, bounds.lower_z);
+    m_scene_max = glm::vec3(bounds.upper_x, bounds.upper_y, bounds.upper_z);
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Index into m_triangle_colors of a hit. Hits in a flattened scene have no instance ID and belong to instance zero.
+uint32_t LightmapBaker::hit_triangle(uint32_t inst_id, uint32_t geom_id, uint32_t prim_id)
+{
+    uint32_t mesh = m_instance_meshes[inst_id == RTC_INVALID_GEOMETRY_ID ? 0 : inst_id];
+    return m_geometry_first_triangle[m_mesh_first_geometry[mesh] + geom_id] + prim_id;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Embree reports the geometric normal of instanced hits in object space.
+glm::vec3 LightmapBaker::hit_normal(uint32_t inst_id, glm::vec3 ng)
+{
+    if (inst_id != RTC_INVALID_GEOMETRY_ID)
+        ng = m_instance_normal_matrices[inst_id] * ng;
+
+    return glm::normalize(ng);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void LightmapBaker::clear_lightmap()
+{
+    std::fill(m_accumulation.begin(), m_accumulation.end(), glm::vec4(0.0f));
+    std::fill(m_sample_counts.begin(), m_sample_counts.end(), 0);
+    std::fill(m_gutter.begin(), m_gutter.end(), 0);
+    std::fill(m_pending.begin(), m_pending.end(), 0);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void LightmapBaker::accumulate(uint32_t point, glm::vec3 color, bool gutter)
+{
+    float l = luminance(color);
+
+    m_accumulation[point] += glm::vec4(color, l * l);
+
+    if (gutter)
+        m_gutter[point] = 1;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void LightmapBaker::resolve(uint32_t point, uint32_t num_samples)
+{
+    m_sample_counts[point] += num_samples;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Standard error of the mean luminance relative to the mean itself.
+float LightmapBaker::relative_error(uint32_t point)
+{
+    float n = float(m_sample_counts[point]);
+
+    if (n < 2.0f)
+        return INFINITY;
+
+    float mean     = luminance(glm::vec3(m_accumulation[point])) / n;
+    float variance = glm::max(m_accumulation[point].a / n - mean * mean, 0.0f) * n / (n - 1.0f);
+
+    return sqrtf(variance / n) / glm::max(mean, 0.0001f);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Writes the mean of every bake point to its texel of the region framebuffer. Texels without a bake point are left
+// black but covered, exactly like an untouched texel of the old dense framebuffer.
+void LightmapBaker::scatter_framebuffer()
+{
+    scatter_framebuffer(m_accumulation);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void LightmapBaker::scatter_framebuffer(const std::vector<glm::vec4>& accumulation)
+{
+    std::fill(m_framebuffer.begin(), m_framebuffer.end(), glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+
+    for (uint32_t i = 0; i < m_bake_points.size(); i++)
+    {
+        glm::vec3 mean = m_sample_counts[i] > 0 ? glm::vec3(accumulation[i]) / float(m_sample_counts[i]) : glm::vec3(0.0f);
+
+        m_framebuffer[region_texel(m_bake_points.texels[i])] = glm::vec4(mean, m_gutter[i] ? 0.0f : 1.0f);
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+glm::vec3 LightmapBaker::sample_cosine_lobe_direction(glm::vec3 n, uint32_t texel, uint32_t sample_idx, uint32_t bounce)
+{
+    glm::vec2 sample = glm::max(glm::vec2(0.00001f), glm::vec2(random_float(texel, sample_idx, bounce, 0), random_float(texel, sample_idx, bounce, 1)));
+
+    const float phi = 2.0f * M_PI * sample.y;
+
+    const float cos_theta = sqrt(sample.x);
+    const float sin_theta = sqrt(1 - sample.x);
+
+    glm::vec3 t = glm::vec3(sin_theta * cos(phi), sin_theta * sin(phi), cos_theta);
+
+    assert(!is_nan(t));
+
+    return glm::normalize(make_rotation_matrix(n) * t);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool LightmapBaker::is_visible(RTCIntersectContext& context, glm::vec3 p, glm::vec3 l)
+{
+    RTCRay rayhit;
+
+    rayhit.dir_x = l.x;
+    rayhit.dir_y = l.y;
+    rayhit.dir_z = l.z;
+
+    rayhit.org_x = p.x;
+    rayhit.org_y = p.y;
+    rayhit.org_z = p.z;
+
+    rayhit.tnear = 0;
+    rayhit.tfar  = INFINITY;
+    rayhit.mask  = -1;
+    rayhit.flags = 0;
+
+    rtcOccluded1(m_embree_scene, &context, &rayhit);
+
+    return rayhit.tfar == INFINITY;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+glm::vec3 LightmapBaker::evaluate_direct_lighting(RTCIntersectContext& context, glm::vec3 p, glm::vec3 n, glm::vec3 albedo)
+{
+    const glm::vec3 l  = -m_light_direction;
+    const glm::vec3 li = m_light_color;
+
+    // Is it visible?
+    if (is_visible(context, p, l))
+        return li * diffuse_lambert(albedo) * glm::max(glm::dot(n, l), 0.0f);
+
+    return glm::vec3(0.0f);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+glm::vec3 LightmapBaker::sample_sky_light(Skybox* skybox, glm::vec3 n, uint32_t texel, uint32_t sample, uint32_t bounce, glm::vec3& l)
+{
+    float pdf;
+    l = skybox->sample_sky_direction(glm::vec2(random_float(texel, sample, bounce, 2), random_float(texel, sample, bounce, 3)), pdf);
+
+    float cos_theta = glm::dot(n, l);
+
+    if (pdf <= 0.0f || cos_theta <= 0.0f)
+        return glm::vec3(0.0f);
+
+    // Same cosine-weighted estimator as the bounce rays, but for a direction drawn from the sky distribution.
+    float bsdf_pdf = cos_theta / float(M_PI);
+
+    return skybox->lookup_sky(l) * (bsdf_pdf / pdf) * mis_weight(pdf, bsdf_pdf);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+float LightmapBaker::sky_hit_weight(Skybox* skybox, glm::vec3 n, glm::vec3 d)
+{
+    if (!m_sky_sampling)
+        return 1.0f;
+
+    return mis_weight(glm::max(glm::dot(n, d), 0.0f) / float(M_PI), skybox->sky_pdf(d));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+glm::vec3 LightmapBaker::path_trace(glm::vec3 direction, glm::vec3 position, uint32_t texel, uint32_t sample, bool& gutter, RelightPath* record, RelightVertex* record_vertices, BakeCounters* counters)
+{
+    glm::vec3 color;
+    RTCRayHit rayhit;
+
+    glm::vec3 p = position;
+    glm::vec3 n = direction;
+    glm::vec3 d = direction;
+
+    p += n * m_offset;
+
+    color                 = glm::vec3(0.0f);
+    glm::vec3 attenuation = glm::vec3(1.0f);
+
+    RTCIntersectContext intersect_context;
+    rtcInitIntersectContext(&intersect_context);
+
+    if (record)
+    {
+        *record            = { 0, texel, sample, 1, 0, 0, 0, glm::vec3(0.0f) };
+        record_vertices[0] = { p, n, attenuation };
+    }
+
+    for (int i = 0; i < m_bake_bounces; i++)
+    {
+        d = sample_cosine_lobe_direction(n, texel, sample, i);
+
+        if (record)
+            record->num_rays++;
+
+        // Next event estimation toward the sky, combined with the bounce ray below by multiple importance sampling.
+        if (m_sky_sampling)
+        {
+            glm::vec3 l;
+            glm::vec3 li = sample_sky_light(m_skybox, n, texel, sample, i, l);
+
+            if (li != glm::vec3(0.0f))
+            {
+                if (counters)
+                    counters->shadow_rays++;
+
+                if (is_visible(intersect_context, p, l))
+                    color += li * attenuation;
+            }
+        }
+
+        create_ray(d, p, rayhit);
+
+        rtcIntersect1(m_embree_scene, &intersect_context, &rayhit);
+
+        if (counters)
+            counters->rays++;
+
+        // Does intersect scene
+        if (rayhit.hit.geomID == RTC_INVALID_GEOMETRY_ID)
+        {
+            if (counters)
+                counters->sky_escapes++;
+
+            if (record)
+            {
+                record->escaped          = 1;
+                record->escape_direction = d;
+            }
+
+            float sky_dir = d.y < 0.0f ? 0.0f : 1.0f;
+            return color + m_skybox->lookup_sky(d) * sky_dir * sky_hit_weight(m_skybox, n, d) * attenuation;
+        }
+
+        uint32_t v_idx = hit_triangle(rayhit.hit.instID[0], rayhit.hit.geomID, rayhit.hit.primID);
+
+        const glm::vec3 albedo = m_triangle_colors[v_idx];
+
+        p = p + d * rayhit.ray.tfar;
+        n = hit_normal(rayhit.hit.instID[0], glm::vec3(rayhit.hit.Ng_x, rayhit.hit.Ng_y, rayhit.hit.Ng_z));
+
+        if (is_triangle_back_facing(n, d))
+        {
+            if (i == 0)
+                gutter = true;
+
+            break;
+        }
+        // Add bias to position
+        p += glm::sign(n) * abs(p * 0.0000002f);
+
+        color += evaluate_direct_lighting(intersect_context, p, n, albedo) * attenuation;
+
+        if (counters)
+            counters->shadow_rays++;
+
+        attenuation *= albedo;
+
+        if (record)
+            record_vertices[record->num_vertices++] = { p, n, attenuation };
+    }
+
+    return color;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void LightmapBaker::bake_scalar(BakeWorkspace& workspace, const uint32_t* points, uint32_t num_points, uint32_t num_samples, RelightTile* cache)
+{
+    uint32_t first_path = 0;
+
+    if (cache)
+    {
+        first_path = cache->paths.size();
+        cache->paths.resize(first_path + num_points * num_samples);
+        cache->vertices.resize(cache->paths.size() * m_relight_stride);
+    }
+
+    for (uint32_t sample = 0; sample < num_samples; sample++)
+    {
+        for (uint32_t i = 0; i < num_points; i++)
+        {
+            uint32_t point = points[i];
+            uint32_t texel = m_bake_points.texels[point];
+
+            RelightPath*   record          = nullptr;
+            RelightVertex* record_vertices = nullptr;
+
+            if (cache)
+            {
+                uint32_t path   = first_path + num_points * sample + i;
+                record          = &cache->paths[path];
+                record_vertices = &cache->vertices[path * m_relight_stride];
+            }
+
+            bool      is_gutter = false;
+            glm::vec3 color     = path_trace(m_bake_points.directions[point], m_bake_points.positions[point], texel, m_sample_counts[point] + sample, is_gutter, record, record_vertices, &workspace.counters);
+
+            if (record)
+            {
+                record->point  = point;
+                record->gutter = is_gutter;
+            }
+
+            accumulate(point, color, is_gutter);
+            m_baking_progress++;
+        }
+    }
+
+    workspace.counters.paths += uint64_t(num_points) * num_samples;
+
+    for (uint32_t i = 0; i < num_points; i++)
+        resolve(points[i], num_samples);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Wavefront version of path_trace(): one bounce of a whole batch of paths is gathered into a ray stream, sorted for
+// coherence and traced with a single stream call, followed by a second stream call for all of the shadow rays.
+void LightmapBaker::bake_stream(BakeWorkspace& workspace, const uint32_t* points, uint32_t num_points, uint32_t num_samples, RelightTile* cache)
+{
+    RayStream&               bounce_rays = workspace.bounce_rays;
+    RayStream&               shadow_rays = workspace.shadow_rays;
+    std::vector<StreamPath>& paths       = workspace.paths;
+
+    const glm::vec3 l = -m_light_direction;
+
+    uint32_t first_path = 0;
+
+    if (cache)
+    {
+        first_path = cache->paths.size();
+        cache->paths.resize(first_path + num_points * num_samples);
+        cache->vertices.resize(cache->paths.size() * m_relight_stride);
+    }
+
+    // Recorded path of a lane in the current batch.
+    auto record = [&](uint32_t sample, uint32_t batch_start, uint32_t lane) {
+        return first_path + num_points * sample + batch_start + lane;
+    };
+
+    for (uint32_t sample = 0; sample < num_samples; sample++)
+    {
+        for (uint32_t batch_start = 0; batch_start < num_points; batch_start += BAKE_STREAM_SIZE)
+        {
+            uint32_t batch_size = std::min(uint32_t(BAKE_STREAM_SIZE), num_points - batch_start);
+
+            for (uint32_t i = 0; i < batch_size; i++)
+            {
+                uint32_t    point = points[batch_start + i];
+                StreamPath& path  = paths[i];
+
+                path.p           = m_bake_points.positions[point] + m_bake_points.directions[point] * m_offset;
+                path.n           = m_bake_points.directions[point];
+                path.attenuation = glm::vec3(1.0f);
+                path.color       = glm::vec3(0.0f);
+                path.point       = point;
+                path.texel       = m_bake_points.texels[point];
+                path.sample      = m_sample_counts[point] + sample;
+                path.alive       = true;
+                path.gutter      = false;
+
+                if (cache)
+                {
+                    uint32_t r = record(sample, batch_start, i);
+
+                    cache->paths[r]                       = { path.point, path.texel, path.sample, 1, 0, 0, 0, glm::vec3(0.0f) };
+                    cache->vertices[r * m_relight_stride] = { path.p, path.n, path.attenuation };
+                }
+            }
+
+            for (int bounce = 0; bounce < m_bake_bounces; bounce++)
+            {
+                bounce_rays.clear();
+                shadow_rays.clear();
+
+                for (uint32_t i = 0; i < batch_size; i++)
+                {
+                    StreamPath& path = paths[i];
+
+                    if (!path.alive)
+                        continue;
+
+                    bounce_rays.push(path.p, sample_cosine_lobe_direction(path.n, path.texel, path.sample, bounce), i);
+
+                    if (cache)
+                        cache->paths[record(sample, batch_start, i)].num_rays++;
+
+                    if (m_sky_sampling)
+                    {
+                        glm::vec3 l;
+                        glm::vec3 li = sample_sky_light(m_skybox, path.n, path.texel, path.sample, bounce, l);
+
+                        if (li != glm::vec3(0.0f))
+                        {
+                            path.sky = li * path.attenuation;
+                            shadow_rays.push(path.p, l, 2 * i + 1);
+                        }
+                    }
+                }
+
+                if (bounce_rays.size() == 0)
+                    break;
+
+                bounce_rays.sort(m_scene_min, m_scene_max);
+                bounce_rays.intersect(m_embree_scene);
+
+                workspace.counters.rays += bounce_rays.size();
+
+                for (uint32_t i = 0; i < bounce_rays.size(); i++)
+                {
+                    StreamPath& path = paths[bounce_rays.id(i)];
+                    glm::vec3   d    = bounce_rays.direction(i);
+
+                    // Does intersect scene
+                    if (!bounce_rays.is_hit(i))
+                    {
+                        workspace.counters.sky_escapes++;
+
+                        if (cache)
+                        {
+                            RelightPath& r     = cache->paths[record(sample, batch_start, bounce_rays.id(i))];
+                            r.escaped          = 1;
+                            r.escape_direction = d;
+                        }
+
+                        float sky_dir = d.y < 0.0f ? 0.0f : 1.0f;
+                        path.color += m_skybox->lookup_sky(d) * sky_dir * sky_hit_weight(m_skybox, path.n, d) * path.attenuation;
+                        path.alive = false;
+                        continue;
+                    }
+
+                    const glm::vec3 albedo = m_triangle_colors[hit_triangle(bounce_rays.inst_id(i), bounce_rays.geom_id(i), bounce_rays.prim_id(i))];
+
+                    path.p = bounce_rays.origin(i) + d * bounce_rays.tfar(i);
+                    path.n = hit_normal(bounce_rays.inst_id(i), bounce_rays.normal(i));
+
+                    if (is_triangle_back_facing(path.n, d))
+                    {
+                        if (bounce == 0)
+                            path.gutter = true;
+
+                        path.alive = false;
+                        continue;
+                    }
+
+                    // Add bias to position
+                    path.p += glm::sign(path.n) * abs(path.p * 0.0000002f);
+
+                    // The direct lighting contribution is only added once its shadow ray is known to be unoccluded.
+                    path.direct = m_light_color * diffuse_lambert(albedo) * glm::max(glm::dot(path.n, l), 0.0f) * path.attenuation;
+                    shadow_rays.push(path.p, l, 2 * bounce_rays.id(i));
+
+                    path.attenuation *= albedo;
+
+                    if (cache)
+                    {
+                        uint32_t     r = record(sample, batch_start, bounce_rays.id(i));
+                        RelightPath& p = cache->paths[r];
+
+                        cache->vertices[r * m_relight_stride + p.num_vertices++] = { path.p, path.n, path.attenuation };
+                    }
+                }
+
+                // Shadow rays toward the sun (even ids) and the sky (odd ids) of every path are traced together.
+                shadow_rays.sort(m_scene_min, m_scene_max);
+                shadow_rays.occluded(m_embree_scene);
+
+                workspace.counters.shadow_rays += shadow_rays.size();
+
+                for (uint32_t i = 0; i < shadow_rays.size(); i++)
+                {
+                    if (shadow_rays.is_occluded(i))
+                        continue;
+
+                    StreamPath& path = paths[shadow_rays.id(i) / 2];
+
+                    path.color += (shadow_rays.id(i) & 1) ? path.sky : path.direct;
+                }
+            }
+
+            for (uint32_t i = 0; i < batch_size; i++)
+            {
+                accumulate(paths[i].point, paths[i].color, paths[i].gutter);
+
+                if (cache)
+                    cache->paths[record(sample, batch_start, i)].gutter = paths[i].gutter;
+            }
+
+            m_baking_progress += batch_size;
+            workspace.counters.paths += batch_size;
+        }
+    }
+
+    for (uint32_t i = 0; i < num_points; i++)
+        resolve(points[i], num_samples);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void LightmapBaker::bake_points(BakeWorkspace& workspace, const uint32_t* points, uint32_t num_points, uint32_t num_samples, RelightTile* cache)
+{
+    if (m_stream_tracing)
+        bake_stream(workspace, points, num_points, num_samples, cache);
+    else
+        bake_scalar(workspace, points, num_points, num_samples, cache);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// With resume set the samples are added on top of the current accumulation, e.g. one loaded from a bake cache. Sample
+// indices continue from the per-texel sample counts, so resuming gives the same result as a single longer bake. If the
+// accumulation is a checkpoint of an interrupted bake, resuming only bakes the points that bake had not finished.
+void LightmapBaker::bake(bool resume)
+{
+    stop_checkpoints();
+
+    // Every budget below is derived from the sample count, a round without samples would never let adaptive sampling
+    // drop a texel.
+    if (m_num_samples < 1)
+    {
+        DW_LOG_WARNING("Sample count must be at least 1, baking with 1 sample");
+        m_num_samples = 1;
+    }
+
+    bool finish = resume && has_pending_points();
+
+    if (!resume)
+        clear_lightmap();
+
+    // The settings are keyed as they are now, so edits made while the tasks run cannot relabel the result.
+    m_bake_key = bake_cache_key();
+
+    if (!finish)
+        std::fill(m_pending.begin(), m_pending.end(), 1);
+
+    const uint32_t max_samples = std::max(m_max_samples, m_num_samples);
+
+    // Adaptive sampling takes every point up to max_samples at most, counting the samples it already has.
+    m_total_samples_to_bake = 0;
+
+    for (uint32_t i = 0; i < m_pending.size(); i++)
+    {
+        if (m_pending[i])
+            m_total_samples_to_bake += m_adaptive_sampling ? max_samples - std::min(m_sample_counts[i], max_samples) : m_num_samples;
+    }
+
+    m_baking_progress       = 0;
+    m_next_tile             = 0;
+
+    m_relight_tiles.clear();
+    m_bake_bounces   = m_num_bounces;
+    m_relight_stride = m_bake_bounces + 1;
+
+    if (m_record_relight)
+        m_relight_tiles.resize(m_bake_tiles.empty() ? 0 : m_bake_tiles.size() - 1);
+
+    begin_bake_timer();
+    start_checkpoints();
+
+    launch_tasks([this](void* data) {
+        bake_tiles();
+    });
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// One task per worker, each pulling tiles until none are left, so the load balances itself however expensive
+// individual tiles turn out to be.
+void LightmapBaker::launch_tasks(const std::function<void(void*)>& function)
+{
+    std::vector<dw::Task*> tasks(m_thread_pool.num_worker_threads());
+
+    for (uint32_t i = 0; i < tasks.size(); i++)
+    {
+        tasks[i]           = m_thread_pool.allocate();
+        tasks[i]->function = function;
+
+        if (i != 0)
+        {
+            m_thread_pool.add_as_child(tasks[0], tasks[i]);
+            m_thread_pool.enqueue(tasks[i]);
+        }
+    }
+
+    m_thread_pool.enqueue(tasks[0]);
+
+    m_bake_parent_task = tasks[0];
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void LightmapBaker::bake_tiles()
+{
+    const uint32_t num_tiles   = m_bake_tiles.empty() ? 0 : uint32_t(m_bake_tiles.size() - 1);
+    const uint32_t max_samples = std::max(m_max_samples, m_num_samples);
+
+    BakeWorkspace workspace;
+
+    workspace.bounce_rays.reserve(BAKE_STREAM_SIZE);
+    workspace.shadow_rays.reserve(BAKE_STREAM_SIZE);
+    workspace.paths.resize(BAKE_STREAM_SIZE);
+
+    for (uint32_t tile = m_next_tile++; tile < num_tiles; tile = m_next_tile++)
+    {
+        std::vector<uint32_t>& points = workspace.points;
+        RelightTile*           cache  = m_relight_tiles.empty() ? nullptr : &m_relight_tiles[tile];
+
+        points.clear();
+
+        for (uint32_t i = m_bake_tiles[tile]; i < m_bake_tiles[tile + 1]; i++)
+        {
+            if (m_pending[i])
+                points.push_back(i);
+        }
+
+        if (!m_adaptive_sampling)
+        {
+            bake_points(workspace, points.data(), points.size(), m_num_samples, cache);
+            points.clear();
+        }
+
+        // Adaptive sampling bakes the tile in rounds of up to m_num_samples, dropping every texel whose estimate has
+        // converged or that has reached max_samples, including texels a previous bake already finished. After Add
+        // Samples or a resumed checkpoint the texels of a tile can hold different sample counts, so every round bakes
+        // each run of equal counts with its own budget.
+        while (!points.empty())
+        {
+            uint32_t num_active = 0;
+
+            for (uint32_t point : points)
+            {
+                if (m_sample_counts[point] < max_samples && !m_gutter[point] && relative_error(point) > m_error_threshold)
+                    points[num_active++] = point;
+                else
+                    m_baking_progress += max_samples - std::min(m_sample_counts[point], max_samples);
+            }
+
+            points.resize(num_active);
+
+            std::stable_sort(points.begin(), points.end(), [this](uint32_t a, uint32_t b) {
+                return m_sample_counts[a] < m_sample_counts[b];
+            });
+
+            uint32_t num_baked = 0;
+
+            for (uint32_t first = 0, last = 0; first < points.size(); first = last)
+            {
+                const uint32_t count       = m_sample_counts[points[first]];
+                const uint32_t num_samples = std::min(uint32_t(m_num_samples), max_samples - count);
+
+                while (last < points.size() && m_sample_counts[points[last]] == count)
+                    last++;
+
+                bake_points(workspace, &points[first], last - first, num_samples, cache);
+
+                num_baked += num_samples;
+            }
+
+            // A round that added no samples would leave every texel where it was.
+            if (num_baked == 0)
+                break;
+        }
+
+        std::fill(m_pending.begin() + m_bake_tiles[tile], m_pending.begin() + m_bake_tiles[tile + 1], 0);
+
+        workspace.counters.gutter_texels += std::count(m_gutter.begin() + m_bake_tiles[tile], m_gutter.begin() + m_bake_tiles[tile + 1], 1);
+
+        // Publishes the finished tile to the checkpoint thread, which never reads a tile before this.
+        if (m_checkpoint.tiles_done)
+            m_checkpoint.tiles_done[tile].store(true, std::memory_order_release);
+
+        if (cache && !m_scenarios.empty())
+        {
+            for (uint32_t i = 0; i < m_scenarios.size(); i++)
+                relight_tile(workspace, *cache, m_scenarios[i], &m_scenario_accumulation[i]);
+
+            *cache = RelightTile();
+        }
+    }
+
+    add_bake_stats(workspace.counters);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool LightmapBaker::has_relight_cache()
+{
+    return !m_relight_tiles.empty();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Re-evaluates the recorded paths of the last bake for the current light direction and sky. Only the sun and sky
+// shadow rays are traced, the bounce rays and their hits are reused from the cache.
+void LightmapBaker::relight()
+{
+    clear_lightmap();
+
+    m_bake_key = bake_cache_key();
+
+    m_total_samples_to_bake = 0;
+    m_baking_progress       = 0;
+    m_next_tile             = 0;
+
+    for (const RelightTile& cache : m_relight_tiles)
+        m_total_samples_to_bake += cache.paths.size();
+
+    begin_bake_timer();
+
+    launch_tasks([this](void* data) {
+        relight_tiles();
+    });
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void LightmapBaker::relight_tiles()
+{
+    BakeWorkspace workspace;
+
+    const LightScenario scenario = { m_light_direction, m_skybox };
+
+    for (uint32_t tile = m_next_tile++; tile < m_relight_tiles.size(); tile = m_next_tile++)
+    {
+        relight_tile(workspace, m_relight_tiles[tile], scenario);
+
+        m_baking_progress += m_relight_tiles[tile].paths.size();
+    }
+
+    add_bake_stats(workspace.counters);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Relights one tile of the cache for the given scenario. Without a target accumulation the result goes to the bake
+// state like a regular bake, otherwise only its radiance is added to the target.
+void LightmapBaker::relight_tile(BakeWorkspace& workspace, const RelightTile& cache, const LightScenario& scenario, std::vector<glm::vec4>* accumulation)
+{
+    RayStream&              shadow_rays   = workspace.shadow_rays;
+    std::vector<glm::vec3>& colors        = workspace.colors;
+    std::vector<uint32_t>&  shadow_paths  = workspace.shadow_paths;
+    std::vector<glm::vec3>& shadow_colors = workspace.shadow_colors;
+
+    const glm::vec3 l = -scenario.light_direction;
+
+    colors.assign(cache.paths.size(), glm::vec3(0.0f));
+    shadow_paths.clear();
+    shadow_colors.clear();
+    shadow_rays.clear();
+
+    for (uint32_t i = 0; i < cache.paths.size(); i++)
+    {
+        const RelightPath&   path     = cache.paths[i];
+        const RelightVertex* vertices = &cache.vertices[i * m_relight_stride];
+
+        for (uint32_t k = 0; k < path.num_vertices; k++)
+        {
+            const RelightVertex& vertex = vertices[k];
+
+            // Direct sunlight at every surface hit, exactly like evaluate_direct_lighting().
+            if (k > 0)
+            {
+                glm::vec3 direct = m_light_color * glm::max(glm::dot(vertex.normal, l), 0.0f) * vertex.throughput;
+
+                if (direct != glm::vec3(0.0f))
+                {
+                    shadow_rays.push(vertex.position, l, shadow_paths.size());
+                    shadow_paths.push_back(i);
+                    shadow_colors.push_back(direct);
+                }
+            }
+
+            // The sky distribution depends on the sun, so its samples are drawn again with the same random numbers.
+            if (m_sky_sampling && k < path.num_rays)
+            {
+                glm::vec3 sky_dir;
+                glm::vec3 li = sample_sky_light(scenario.skybox, vertex.normal, path.texel, path.sample, k, sky_dir);
+
+                if (li != glm::vec3(0.0f))
+                {
+                    shadow_rays.push(vertex.position, sky_dir, shadow_paths.size());
+                    shadow_paths.push_back(i);
+                    shadow_colors.push_back(li * vertex.throughput);
+                }
+            }
+        }
+
+        if (path.escaped)
+        {
+            const RelightVertex& last = vertices[path.num_vertices - 1];
+            glm::vec3            d    = path.escape_direction;
+            float                up   = d.y < 0.0f ? 0.0f : 1.0f;
+
+            colors[i] += scenario.skybox->lookup_sky(d) * up * sky_hit_weight(scenario.skybox, last.normal, d) * last.throughput;
+        }
+    }
+
+    shadow_rays.sort(m_scene_min, m_scene_max);
+    shadow_rays.occluded(m_embree_scene);
+
+    workspace.counters.paths += cache.paths.size();
+    workspace.counters.shadow_rays += shadow_rays.size();
+
+    for (uint32_t i = 0; i < shadow_rays.size(); i++)
+    {
+        if (!shadow_rays.is_occluded(i))
+            colors[shadow_paths[shadow_rays.id(i)]] += shadow_colors[shadow_rays.id(i)];
+    }
+
+    for (uint32_t i = 0; i < cache.paths.size(); i++)
+    {
+        if (accumulation)
+        {
+            float lum = luminance(colors[i]);
+
+            (*accumulation)[cache.paths[i].point] += glm::vec4(colors[i], lum * lum);
+        }
+        else
+        {
+            accumulate(cache.paths[i].point, colors[i], cache.paths[i].gutter);
+            resolve(cache.paths[i].point, 1);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Bakes several lighting scenarios from a single set of bounce paths. The first scenario is path traced while
+// recording the relight cache and every other one is relit from it as soon as a tile finishes, so bounce ray traversal
+// is paid once, each additional scenario only costs its shadow rays and the cache never holds more than the tiles in
+// flight. Blocks until all scenarios are done.
+void LightmapBaker::bake_scenarios(const std::vector<LightScenario>& scenarios, std::vector<std::vector<glm::vec4>>& framebuffers)
+{
+    const bool      record_relight  = m_record_relight;
+    const glm::vec3 light_direction = m_light_direction;
+    Skybox*         skybox          = m_skybox;
+
+    m_light_direction = scenarios[0].light_direction;
+    m_skybox          = scenarios[0].skybox;
+    m_record_relight  = scenarios.size() > 1;
+
+    m_scenarios.assign(scenarios.begin() + 1, scenarios.end());
+    m_scenario_accumulation.assign(m_scenarios.size(), std::vector<glm::vec4>(m_bake_points.size(), glm::vec4(0.0f)));
+
+    bake();
+    wait();
+
+    framebuffers.resize(scenarios.size());
+
+    for (uint32_t i = 0; i < scenarios.size(); i++)
+    {
+        if (i == 0)
+            scatter_framebuffer();
+        else
+            scatter_framebuffer(m_scenario_accumulation[i - 1]);
+
+        framebuffers[i] = m_framebuffer;
+    }
+
+    // Every tile of the cache has been relit and freed, none of it is left to relight the first scenario with.
+    m_scenarios.clear();
+    m_scenario_accumulation.clear();
+    m_relight_tiles.clear();
+
+    m_record_relight  = record_relight;
+    m_light_direction = light_direction;
+    m_skybox          = skybox;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Out-of-core version of bake_scenarios() for atlases that do not fit in memory. The current page is baked one region
+// of m_stream_tile_size^2 texels at a time, from rasterizing its bake points to flushing the finished framebuffer of
+// every scenario to <output path>.tiles, so peak memory is bounded by the region rather than the atlas. Once all
+// regions are done the tiled files are dilated into the final .hdr files.
+bool LightmapBaker::bake_streamed(const std::vector<LightScenario>& scenarios, const std::vector<std::string>& output_paths)
+{
+    const int tile_size     = m_stream_tile_size;
+    const int tiles_per_row = (m_lightmap_size + tile_size - 1) / tile_size;
+
+    std::vector<std::unique_ptr<TiledLightmapWriter>> writers;
+
+    for (const std::string& path : output_paths)
+    {
+        writers.push_back(std::make_unique<TiledLightmapWriter>());
+
+        if (!writers.back()->open(path + ".tiles", m_lightmap_size, tile_size))
+        {
+            DW_LOG_ERROR("Failed to create tiled lightmap");
+            return false;
+        }
+    }
+
+    std::vector<std::vector<glm::vec4>> framebuffers;
+
+    for (int tile_y = 0; tile_y < tiles_per_row; tile_y++)
+    {
+        for (int tile_x = 0; tile_x < tiles_per_row; tile_x++)
+        {
+            glm::ivec2 origin = glm::ivec2(tile_x, tile_y) * tile_size;
+            glm::ivec2 extent = glm::min(origin + tile_size, glm::ivec2(m_lightmap_size)) - origin;
+
+            set_region(origin, extent);
+            initialize_bake_points(m_conservative);
+
+            if (m_bake_points.empty())
+            {
+                scatter_framebuffer();
+                framebuffers.assign(scenarios.size(), m_framebuffer);
+            }
+            else if (scenarios.size() == 1)
+            {
+                m_light_direction = scenarios[0].light_direction;
+                m_skybox          = scenarios[0].skybox;
+
+                bake();
+                wait();
+                scatter_framebuffer();
+
+                framebuffers.assign(1, m_framebuffer);
+            }
+            else
+                bake_scenarios(scenarios, framebuffers);
+
+            for (uint32_t i = 0; i < writers.size(); i++)
+            {
+                if (!writers[i]->write_tile(tile_x, tile_y, framebuffers[i].data(), extent))
+                {
+                    DW_LOG_ERROR("Failed to write lightmap tile");
+                    return false;
+                }
+            }
+        }
+    }
+
+    // Dilation happens row by row while the .hdr is written, so the whole conversion counts as writing.
+    ScopedPhaseTimer timer(m_stats, BAKE_PHASE_WRITE);
+
+    for (uint32_t i = 0; i < writers.size(); i++)
+    {
+        if (!writers[i]->close() || !convert_tiled_lightmap_to_hdr(output_paths[i] + ".tiles", output_paths[i]))
+        {
+            DW_LOG_ERROR("Failed to convert tiled lightmap");
+            return false;
+        }
+
+        // The tiled file only spools the regions until they are converted.
+        remove((output_paths[i] + ".tiles").c_str());
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void LightmapBaker::convergence_heat_map(std::vector<glm::vec4>& heat_map)
+{
+    const float max_samples = float(m_adaptive_sampling ? std::max(m_max_samples, m_num_samples) : m_num_samples);
+
+    heat_map.assign(m_framebuffer.size(), glm::vec4(0.0f));
+
+    for (uint32_t i = 0; i < m_bake_points.size(); i++)
+    {
+        if (m_sample_counts[i] > 0)
+        {
+            // Blue for texels that converged after the first round through green to red for texels that hit the limit.
+            float t = glm::clamp(float(m_sample_counts[i]) / max_samples, 0.0f, 1.0f);
+
+            heat_map[region_texel(m_bake_points.texels[i])] = glm::vec4(glm::clamp(2.0f * t - 1.0f, 0.0f, 1.0f), 1.0f - fabsf(2.0f * t - 1.0f), glm::clamp(1.0f - 2.0f * t, 0.0f, 1.0f), 1.0f);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool LightmapBaker::has_pending_points()
+{
+    return std::find(m_pending.begin(), m_pending.end(), 1) != m_pending.end();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Snapshots the state every tile starts from, which is what a checkpoint holds for tiles that are still being baked,
+// and starts the checkpoint thread. The bake tasks are never paused, and only pay for one flag store per tile.
+void LightmapBaker::start_checkpoints()
+{
+    if (m_checkpoint_path.empty() || m_checkpoint_interval <= 0)
+        return;
+
+    const uint32_t num_tiles = m_bake_tiles.empty() ? 0 : uint32_t(m_bake_tiles.size() - 1);
+
+    m_checkpoint.accumulation  = m_accumulation;
+    m_checkpoint.sample_counts = m_sample_counts;
+    m_checkpoint.gutter        = m_gutter;
+    m_checkpoint.pending       = m_pending;
+    m_checkpoint.stop          = false;
+
+    m_checkpoint.tiles_done.reset(new std::atomic<bool>[num_tiles]);
+
+    for (uint32_t i = 0; i < num_tiles; i++)
+        m_checkpoint.tiles_done[i].store(false, std::memory_order_relaxed);
+
+    m_checkpoint.thread = std::thread([this]() {
+        std::unique_lock<std::mutex> lock(m_checkpoint.mutex);
+
+        while (!m_checkpoint.condition.wait_for(lock, std::chrono::seconds(m_checkpoint_interval), [this]() { return m_checkpoint.stop; }))
+        {
+            if (!save_checkpoint())
+                DW_LOG_ERROR("Failed to write bake checkpoint");
+        }
+    });
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Waits for a checkpoint that is being written, so nothing replaces the bake cache once this returns.
+void LightmapBaker::stop_checkpoints()
+{
+    if (!m_checkpoint.thread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_checkpoint.mutex);
+        m_checkpoint.stop = true;
+    }
+
+    m_checkpoint.condition.notify_one();
+    m_checkpoint.thread.join();
+
+    m_checkpoint.accumulation  = std::vector<glm::vec4>();
+    m_checkpoint.sample_counts = std::vector<uint32_t>();
+    m_checkpoint.gutter        = std::vector<uint8_t>();
+    m_checkpoint.pending       = std::vector<uint8_t>();
+    m_checkpoint.tiles_done.reset();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Written next to the checkpoint and renamed over it, so an interrupted write never leaves a torn file behind.
+bool LightmapBaker::save_checkpoint()
+{
+    BakeCacheData data;
+
+    gather_bake_cache(data, true);
+
+    const std::string temp_path = m_checkpoint_path + ".tmp";
+
+    if (!write_bake_cache(temp_path, m_bake_key, m_lightmap_size, data))
+        return false;
+
+#if defined(_WIN32)
+    remove(m_checkpoint_path.c_str());
+#endif
+
+    return rename(temp_path.c_str(), m_checkpoint_path.c_str()) == 0;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool LightmapBaker::is_done()
+{
+    return !m_bake_parent_task || m_thread_pool.is_done(m_bake_parent_task);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void LightmapBaker::wait()
+{
+    while (!is_done())
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    stop_checkpoints();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// The bake phase lasts from launching the tasks until the last of them finishes, which add_bake_stats() keeps track
+// of, so asynchronous bakes are timed without anyone waiting on them.
+void LightmapBaker::begin_bake_timer()
+{
+    m_bake_start         = std::chrono::high_resolution_clock::now();
+    m_bake_start_seconds = m_stats.phase_seconds[BAKE_PHASE_BAKE];
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void LightmapBaker::add_bake_stats(const BakeCounters& counters)
+{
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+
+    m_stats.counters.add(counters);
+    m_stats.phase_seconds[BAKE_PHASE_BAKE] = m_bake_start_seconds + std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - m_bake_start).count();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool LightmapBaker::write_bake_report(const std::string& path, const std::string& scene_name)
+{
+    FILE* f = fopen(path.c_str(), "w");
+
+    if (!f)
+        return false;
+
+    const BakeCounters& counters   = m_stats.counters;
+    const double        bake_time  = m_stats.phase_seconds[BAKE_PHASE_BAKE];
+    const uint64_t      total_rays = counters.rays + counters.shadow_rays;
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"scene\": %s,\n", json_string(scene_name).c_str());
+    fprintf(f, "  \"lightmap_size\": %d,\n", m_lightmap_size);
+    fprintf(f, "  \"page_count\": %u,\n", m_page_count);
+    fprintf(f, "  \"spp\": %d,\n", m_num_samples);
+    fprintf(f, "  \"bounces\": %d,\n", m_num_bounces);
+    fprintf(f, "  \"stream_tracing\": %s,\n", m_stream_tracing ? "true" : "false");
+    fprintf(f, "  \"threads\": %u,\n", uint32_t(m_thread_pool.num_worker_threads()));
+    fprintf(f, "  \"phases\": {\n");
+
+    for (int i = 0; i < BAKE_PHASE_COUNT; i++)
+        fprintf(f, "    \"%s\": %.6f,\n", bake_phase_name(BakePhase(i)), m_stats.phase_seconds[i]);
+
+    fprintf(f, "    \"total\": %.6f\n", m_stats.total_seconds());
+    fprintf(f, "  },\n");
+    fprintf(f, "  \"counters\": {\n");
+    fprintf(f, "    \"paths\": %llu,\n", (unsigned long long)counters.paths);
+    fprintf(f, "    \"rays\": %llu,\n", (unsigned long long)counters.rays);
+    fprintf(f, "    \"shadow_rays\": %llu,\n", (unsigned long long)counters.shadow_rays);
+    fprintf(f, "    \"sky_escapes\": %llu,\n", (unsigned long long)counters.sky_escapes);
+    fprintf(f, "    \"gutter_texels\": %llu,\n", (unsigned long long)counters.gutter_texels);
+    fprintf(f, "    \"average_path_length\": %.4f,\n", counters.paths > 0 ? double(counters.rays) / double(counters.paths) : 0.0);
+    fprintf(f, "    \"rays_per_second\": %.1f\n", bake_time > 0.0 ? double(total_rays) / bake_time : 0.0);
+    fprintf(f, "  }\n");
+    fprintf(f, "}\n");
+
+    return fclose(f) == 0;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void LightmapBaker::dilate(std::vector<glm::vec4>& dilated)
+{
+    ScopedPhaseTimer timer(m_stats, BAKE_PHASE_DILATE);
+
+    dilated.resize(m_framebuffer.size());
+    dilate_lightmap(m_framebuffer.data(), dilated.data(), m_lightmap_size);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool LightmapBaker::denoise(std::vector<glm::vec4>& lightmap)
+{
+    ScopedPhaseTimer timer(m_stats, BAKE_PHASE_DENOISE);
+
+    // The lightmap holds irradiance, which does not include the albedo of the receiving surface, so the albedo guide
+    // only marks the texels covered by bake points. The normals keep the filter from blurring across creases and
+    // across unrelated charts that happen to be neighbours in the atlas.
+    std::vector<glm::vec3> albedo(lightmap.size(), glm::vec3(0.0f));
+    std::vector<glm::vec3> normal(lightmap.size(), glm::vec3(0.0f));
+
+    for (uint32_t i = 0; i < m_bake_points.size(); i++)
+    {
+        uint32_t texel = region_texel(m_bake_points.texels[i]);
+
+        albedo[texel] = glm::vec3(1.0f);
+        normal[texel] = m_bake_points.directions[i];
+    }
+
+    return denoise_lightmap(lightmap.data(), albedo.data(), normal.data(), m_lightmap_size);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Everything that changes what a texel converges to. Sample counts, stream tracing, bake order and sky sampling only
+// change how it gets there, so caches stay valid across them and can be resumed with different settings.
+uint64_t LightmapBaker::bake_cache_key()
+{
+    uint64_t key = m_scene_hash;
+
+    key = hash_value(m_lightmap_size, key);
+    key = hash_value(m_texels_per_unit, key);
+    key = hash_value(m_page, key);
+    key = hash_value(m_num_bounces, key);
+    key = hash_value(m_offset, key);
+    key = hash_value(m_light_direction, key);
+    key = hash_value(m_light_color, key);
+    key = hash_value(m_conservative, key);
+
+    if (m_skybox)
+    {
+        key = hash_value(m_skybox->m_turbidity, key);
+        key = hash_value(m_skybox->m_ground_albedo, key);
+    }
+
+    return key;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// The file stays dense, so it does not depend on the bake points or their order. For a checkpoint, tiles the bake tasks
+// have not finished yet contribute the state they started from, which keeps the file consistent while they run.
+void LightmapBaker::gather_bake_cache(BakeCacheData& data, bool checkpoint)
+{
+    const uint32_t num_tiles = m_bake_tiles.empty() ? 0 : uint32_t(m_bake_tiles.size() - 1);
+
+    data.accumulation.assign(m_framebuffer.size(), glm::vec4(0.0f));
+    data.sample_counts.assign(m_framebuffer.size(), 0);
+    data.flags.assign(m_framebuffer.size(), BAKE_CACHE_TEXEL_COVERED);
+
+    for (uint32_t tile = 0; tile < num_tiles; tile++)
+    {
+        bool done = !checkpoint || m_checkpoint.tiles_done[tile].load(std::memory_order_acquire);
+
+        const glm::vec4* accumulation  = done ? m_accumulation.data() : m_checkpoint.accumulation.data();
+        const uint32_t*  sample_counts = done ? m_sample_counts.data() : m_checkpoint.sample_counts.data();
+        const uint8_t*   gutter        = done ? m_gutter.data() : m_checkpoint.gutter.data();
+        const uint8_t*   pending       = done ? m_pending.data() : m_checkpoint.pending.data();
+
+        for (uint32_t i = m_bake_tiles[tile]; i < m_bake_tiles[tile + 1]; i++)
+        {
+            uint32_t texel = region_texel(m_bake_points.texels[i]);
+
+            data.accumulation[texel]  = accumulation[i];
+            data.sample_counts[texel] = sample_counts[i];
+            data.flags[texel]         = (gutter[i] ? 0 : BAKE_CACHE_TEXEL_COVERED) | (pending[i] ? BAKE_CACHE_TEXEL_PENDING : 0);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool LightmapBaker::save_bake_cache(const std::string& path)
+{
+    BakeCacheData data;
+
+    gather_bake_cache(data, false);
+
+    return write_bake_cache(path, m_bake_key, m_lightmap_size, data);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool LightmapBaker::load_bake_cache(const std::string& path)
+{
+    BakeCacheData data;
+
+    if (!read_bake_cache(path, bake_cache_key(), m_lightmap_size, data))
+        return false;
+
+    m_bake_key = bake_cache_key();
+
+    for (uint32_t i = 0; i < m_bake_points.size(); i++)
+    {
+        uint32_t texel = region_texel(m_bake_points.texels[i]);
+
+        m_accumulation[i]  = data.accumulation[texel];
+        m_sample_counts[i] = data.sample_counts[texel];
+        m_gutter[i]        = (data.flags[texel] & BAKE_CACHE_TEXEL_COVERED) ? 0 : 1;
+        m_pending[i]       = (data.flags[texel] & BAKE_CACHE_TEXEL_PENDING) ? 1 : 0;
+    }
+
+    scatter_framebuffer();
+
+    // Paths recorded for another accumulation would relight into something else than the cached result.
+    m_relight_tiles.clear();
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Keeps only the bake points of one job out of num_jobs. Jobs are contiguous runs of the bake order with the same number
+// of points each, so they take about as long as each other, and a texel bakes exactly the same in any job.
+void LightmapBaker::select_job(uint32_t job, uint32_t num_jobs)
+{
+    const uint32_t first = uint32_t(uint64_t(m_bake_points.size()) * job / num_jobs);
+    const uint32_t end   = uint32_t(uint64_t(m_bake_points.size()) * (job + 1) / num_jobs);
+
+    m_bake_points.positions.assign(m_bake_points.positions.begin() + first, m_bake_points.positions.begin() + end);
+    m_bake_points.directions.assign(m_bake_points.directions.begin() + first, m_bake_points.directions.begin() + end);
+    m_bake_points.texels.assign(m_bake_points.texels.begin() + first, m_bake_points.texels.begin() + end);
+    m_accumulation.assign(m_accumulation.begin() + first, m_accumulation.begin() + end);
+    m_sample_counts.assign(m_sample_counts.begin() + first, m_sample_counts.begin() + end);
+    m_gutter.assign(m_gutter.begin() + first, m_gutter.begin() + end);
+    m_pending.assign(m_pending.begin() + first, m_pending.begin() + end);
+
+    // A run of an ordered sequence is still ordered, so this only rebuilds the tile offsets.
+    build_bake_tiles();
+
+    m_relight_tiles.clear();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool LightmapBaker::save_bake_partial(const std::string& path)
+{
+    BakePartialData data;
+
+    data.accumulation  = m_accumulation;
+    data.texels        = m_bake_points.texels;
+    data.sample_counts = m_sample_counts;
+    data.gutter        = m_gutter;
+
+    return write_bake_partial(path, m_bake_key, m_lightmap_size, data);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Adds a partial bake to the accumulation of the matching bake points. Merging the partials of disjoint jobs, in any
+// order, gives the same bits as baking all points in one process.
+bool LightmapBaker::merge_bake_partial(const std::string& path)
+{
+    BakePartialData data;
+
+    if (!read_bake_partial(path, bake_cache_key(), m_lightmap_size, data))
+        return false;
+
+    m_bake_key = bake_cache_key();
+
+    std::vector<uint32_t> points(m_framebuffer.size(), UINT32_MAX);
+
+    for (uint32_t i = 0; i < m_bake_points.size(); i++)
+        points[region_texel(m_bake_points.texels[i])] = i;
+
+    for (uint32_t i = 0; i < data.texels.size(); i++)
+    {
+        int x = int(data.texels[i] % m_lightmap_size) - m_region_origin.x;
+        int y = int(data.texels[i] / m_lightmap_size) - m_region_origin.y;
+
+        if (x < 0 || y < 0 || x >= m_region_extent.x || y >= m_region_extent.y)
+            return false;
+
+        uint32_t point = points[region_texel(data.texels[i])];
+
+        if (point == UINT32_MAX)
+            return false;
+
+        m_accumulation[point] += data.accumulation[i];
+        m_sample_counts[point] += data.sample_counts[i];
+        m_gutter[point] |= data.gutter[i];
+    }
+
+    m_relight_tiles.clear();
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,277 @@
+#pragma once
+
+#include "bake_stats.h"
+#include "lightmap.h"
+#include "ray_stream.h"
+#include "scene.h"
+#include <thread_pool.hpp>
+#include <rtcore.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define LIGHTMAP_TEXTURE_SIZE 1024
+#define LIGHTMAP_CHART_PADDING 6
+#define LIGHTMAP_SPP 1
+#define LIGHTMAP_BOUNCES 2
+#define LIGHTMAP_MAX_SPP 256
+#define LIGHTMAP_ERROR_THRESHOLD 0.05f
+#define BAKE_STREAM_SIZE 4096
+#define BAKE_TILE_SIZE 32
+
+struct Skybox;
+struct BakeCacheData;
+
+struct StreamPath
+{
+    glm::vec3 p;
+    glm::vec3 n;
+    glm::vec3 attenuation;
+    glm::vec3 color;
+    glm::vec3 direct;
+    glm::vec3 sky;
+    uint32_t  point;
+    uint32_t  texel;
+    uint32_t  sample;
+    bool      alive;
+    bool      gutter;
+};
+
+// A path vertex recorded for relighting. Vertex zero is the bake point itself, every other vertex is a surface hit
+// whose throughput already includes its own albedo, which is also the weight of the sun's contribution there.
+struct RelightVertex
+{
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec3 throughput;
+};
+
+struct RelightPath
+{
+    uint32_t  point;
+    uint32_t  texel;
+    uint32_t  sample;
+    uint8_t   num_vertices;
+    uint8_t   num_rays; // Bounce rays cast, i.e. the vertices that also sampled the sky
+    uint8_t   escaped;  // Whether the last bounce ray left the scene along escape_direction
+    uint8_t   gutter;
+    glm::vec3 escape_direction;
+};
+
+// Recorded paths of one bake tile. Path i owns vertices [i * stride, i * stride + num_vertices).
+struct RelightTile
+{
+    std::vector<RelightPath>   paths;
+    std::vector<RelightVertex> vertices;
+};
+
+// One lighting state of a multi-scenario bake. The skybox must have been initialized for the same sun direction.
+struct LightScenario
+{
+    glm::vec3 light_direction;
+    Skybox*   skybox;
+};
+
+// Scratch memory owned by one bake task and reused for every tile it bakes.
+struct BakeWorkspace
+{
+    RayStream               bounce_rays;
+    RayStream               shadow_rays;
+    std::vector<StreamPath> paths;
+    std::vector<uint32_t>   points;
+    std::vector<glm::vec3>  colors;
+    std::vector<uint32_t>   shadow_paths;
+    std::vector<glm::vec3>  shadow_colors;
+    BakeCounters            counters;
+};
+
+// Checkpoint writer of a running bake. Tiles are marked done by the bake tasks as they finish them, everything else is
+// only touched by the checkpoint thread.
+struct BakeCheckpoint
+{
+    std::vector<glm::vec4>               accumulation; // Bake state every tile started from
+    std::vector<uint32_t>                sample_counts;
+    std::vector<uint8_t>                 gutter;
+    std::vector<uint8_t>                 pending;
+    std::unique_ptr<std::atomic<bool>[]> tiles_done;
+    std::thread                          thread;
+    std::mutex                           mutex;
+    std::condition_variable              condition;
+    bool                                 stop = false;
+};
+
+// Everything needed to go from a scene to a baked lightmap: lightmap UV unwrap, Embree scene, bake points and the
+// path traced accumulation buffer. It never touches the GPU, so it is shared by the interactive sample and the
+// headless command-line bake.
+struct LightmapBaker
+{
+    LightmapBaker(uint32_t num_threads = 0);
+    ~LightmapBaker();
+    bool      initialize(const Scene& scene, Skybox* skybox);
+    bool      initialize(const InstancedScene& scene, Skybox* skybox);
+    void      set_region(glm::ivec2 origin, glm::ivec2 extent);
+    uint32_t  region_texel(uint32_t texel);
+    void      initialize_bake_points(bool conservative);
+    void      build_bake_tiles();
+    void      bake(bool resume = false);
+    void      bake_tiles();
+    void      launch_tasks(const std::function<void(void*)>& function);
+    bool      has_relight_cache();
+    void      relight();
+    void      relight_tiles();
+    void      relight_tile(BakeWorkspace& workspace, const RelightTile& cache, const LightScenario& scenario, std::vector<glm::vec4>* accumulation = nullptr);
+    void      bake_scenarios(const std::vector<LightScenario>& scenarios, std::vector<std::vector<glm::vec4>>& framebuffers);
+    bool      bake_streamed(const std::vector<LightScenario>& scenarios, const std::vector<std::string>& output_paths);
+    void      accumulate(uint32_t point, glm::vec3 color, bool gutter);
+    void      resolve(uint32_t point, uint32_t num_samples);
+    float     relative_error(uint32_t point);
+    void      scatter_framebuffer();
+    void      scatter_framebuffer(const std::vector<glm::vec4>& accumulation);
+    void      convergence_heat_map(std::vector<glm::vec4>& heat_map);
+    bool      has_pending_points();
+    void      start_checkpoints();
+    void      stop_checkpoints();
+    bool      save_checkpoint();
+    bool      is_done();
+    void      wait();
+    void      begin_bake_timer();
+    void      add_bake_stats(const BakeCounters& counters);
+    bool      write_bake_report(const std::string& path, const std::string& scene_name);
+    void      dilate(std::vector<glm::vec4>& dilated);
+    bool      denoise(std::vector<glm::vec4>& lightmap);
+    uint64_t  bake_cache_key();
+    void      gather_bake_cache(BakeCacheData& data, bool checkpoint);
+    bool      save_bake_cache(const std::string& path);
+    bool      load_bake_cache(const std::string& path);
+    void      select_job(uint32_t job, uint32_t num_jobs);
+    bool      save_bake_partial(const std::string& path);
+    bool      merge_bake_partial(const std::string& path);
+    bool      lightmap_uv_unwrap(const InstancedScene& scene);
+    uint64_t  unwrap_cache_key();
+    bool      initialize_embree(const InstancedScene& scene);
+    uint32_t  hit_triangle(uint32_t inst_id, uint32_t geom_id, uint32_t prim_id);
+    glm::vec3 hit_normal(uint32_t inst_id, glm::vec3 ng);
+    void      clear_lightmap();
+    glm::vec3 sample_cosine_lobe_direction(glm::vec3 n, uint32_t texel, uint32_t sample, uint32_t bounce);
+    bool      is_visible(RTCIntersectContext& context, glm::vec3 p, glm::vec3 l);
+    glm::vec3 sample_sky_light(Skybox* skybox, glm::vec3 n, uint32_t texel, uint32_t sample, uint32_t bounce, glm::vec3& l);
+    float     sky_hit_weight(Skybox* skybox, glm::vec3 n, glm::vec3 d);
+    glm::vec3 evaluate_direct_lighting(RTCIntersectContext& context, glm::vec3 p, glm::vec3 n, glm::vec3 albedo);
+    glm::vec3 path_trace(glm::vec3 direction, glm::vec3 position, uint32_t texel, uint32_t sample, bool& gutter, RelightPath* record = nullptr, RelightVertex* record_vertices = nullptr, BakeCounters* counters = nullptr);
+    void      bake_scalar(BakeWorkspace& workspace, const uint32_t* points, uint32_t num_points, uint32_t num_samples, RelightTile* cache);
+    void      bake_stream(BakeWorkspace& workspace, const uint32_t* points, uint32_t num_points, uint32_t num_samples, RelightTile* cache);
+    void      bake_points(BakeWorkspace& workspace, const uint32_t* points, uint32_t num_points, uint32_t num_samples, RelightTile* cache);
+
+    // Lightmap settings
+    int       m_num_samples     = LIGHTMAP_SPP;
+    int       m_num_bounces     = LIGHTMAP_BOUNCES;
+    int       m_lightmap_size   = LIGHTMAP_TEXTURE_SIZE;
+    float     m_offset          = 0.1f;
+    glm::vec3 m_light_direction = -glm::normalize(glm::vec3(0.0f, 0.9770f, 0.5000f));
+    glm::vec3 m_light_color     = glm::vec3(10000.0f);
+    bool      m_stream_tracing  = true;
+    bool      m_spatial_order   = false;
+    bool      m_sky_sampling    = true;
+    bool      m_record_relight  = false;
+    bool      m_denoise         = false;
+
+    // Unwrapped meshes are cached in this file when it is set, and reused for as long as the scene and pack options match.
+    std::string m_unwrap_cache_path;
+
+    // Atlas pages. With m_texels_per_unit left at zero the whole scene is scaled to fit a single page, otherwise xatlas
+    // keeps that density and opens as many pages of m_lightmap_size as it needs. Bake points, framebuffer and caches all
+    // belong to m_page, so pages are baked one after another (or by separate processes) with bounded memory.
+    float    m_texels_per_unit = 0.0f;
+    uint32_t m_page_count      = 1;
+    uint32_t m_page            = 0;
+
+    // Checkpoints: while bake() runs, a background thread writes a bake cache of the finished tiles, and of the state all
+    // other tiles started from, to m_checkpoint_path every m_checkpoint_interval seconds. Loading it and calling
+    // bake(true) finishes the interrupted bake.
+    std::string m_checkpoint_path;
+    int         m_checkpoint_interval = 0;
+
+    // Streamed bake: when set, the buffers only ever hold one region of m_stream_tile_size^2 texels, see bake_streamed().
+    int m_stream_tile_size = 0;
+
+    // Adaptive sampling
+    bool  m_adaptive_sampling = false;
+    int   m_max_samples       = LIGHTMAP_MAX_SPP;
+    float m_error_threshold   = LIGHTMAP_ERROR_THRESHOLD;
+
+    // Unwrapped mesh
+    std::vector<LightmapVertex>  m_vertices;
+    std::vector<uint32_t>        m_indices;
+    std::vector<LightmapSubMesh> m_submeshes;
+    std::vector<uint32_t>        m_vertex_pages; // Atlas page of every vertex
+    std::vector<glm::vec3>       m_triangle_colors;
+
+    // Embree structure: one scene per unique mesh, placed in m_embree_scene by instances with the instance index as
+    // geometry ID, unless there is a single untransformed instance, in which case its mesh scene is traced directly.
+    RTCDevice                                m_embree_device = nullptr;
+    RTCScene                                 m_embree_scene  = nullptr;
+    std::vector<RTCScene>                    m_embree_mesh_scenes;
+    std::vector<uint32_t>                    m_mesh_first_geometry;     // Per mesh, into m_geometry_first_triangle
+    std::vector<uint32_t>                    m_geometry_first_triangle; // Per submesh of every mesh, into m_triangle_colors
+    std::vector<uint32_t>                    m_instance_meshes;
+    std::vector<glm::mat3>                   m_instance_normal_matrices;
+    std::vector<std::shared_ptr<MappedFile>> m_scene_mappings;
+    glm::vec3                                m_scene_min = glm::vec3(0.0f);
+    glm::vec3                                m_scene_max = glm::vec3(0.0f);
+
+    uint64_t               m_scene_hash   = 0;
+    bool                   m_conservative = true;
+    Skybox*                m_skybox       = nullptr;
+    BakePoints            m_bake_points;
+    std::vector<uint32_t> m_bake_tiles; // Offset of the first bake point of every tile, followed by m_bake_points.size()
+
+    // Bake state, one entry per bake point. Only scatter_framebuffer() expands it to the atlas.
+    std::vector<glm::vec4> m_accumulation; // Sum of samples, alpha holds the sum of squared luminance
+    std::vector<uint32_t>  m_sample_counts;
+    std::vector<uint8_t>   m_gutter;
+    std::vector<uint8_t>   m_pending; // Set until the point has been baked by the current (or an interrupted) bake
+    std::vector<glm::vec4> m_framebuffer; // Mean radiance of the region, alpha is zero for gutter texels
+
+    // Rectangle of the atlas covered by the framebuffer and by the bake points. The whole atlas unless a streamed
+    // bake narrows it down to one tile at a time.
+    glm::ivec2 m_region_origin = glm::ivec2(0);
+    glm::ivec2 m_region_extent = glm::ivec2(0);
+
+    // Relight cache, one entry per bake tile, filled by bake() when m_record_relight is set.
+    std::vector<RelightTile> m_relight_tiles;
+    uint32_t                 m_relight_stride = 0;
+
+    // Additional scenarios of bake_scenarios(). bake_tiles() relights every finished tile for each of them into its
+    // own accumulation buffer and then frees the tile's relight cache, so only the tiles in flight are ever cached.
+    // Sample counts and gutter flags are shared with m_accumulation since the paths are the same.
+    std::vector<LightScenario>          m_scenarios;
+    std::vector<std::vector<glm::vec4>> m_scenario_accumulation;
+
+    // m_num_bounces as of the last bake(). The tracers only read this copy, so editing the setting mid-bake can never
+    // record more vertices than a relight path has room for.
+    int m_bake_bounces = LIGHTMAP_BOUNCES;
+
+    // bake_cache_key() of the settings the accumulation was baked, loaded or merged with. Caches, checkpoints and
+    // partials are written under it.
+    uint64_t m_bake_key = 0;
+
+    // Phase timings and path tracer counters. Bake tasks only touch them through add_bake_stats(), so they can be read
+    // without locking once is_done() returns true.
+    BakeStats                                      m_stats;
+    std::mutex                                     m_stats_mutex;
+    std::chrono::high_resolution_clock::time_point m_bake_start;
+    double                                         m_bake_start_seconds = 0.0;
+
+    std::atomic<uint32_t> m_baking_progress       = { 0 };
+    std::atomic<uint32_t> m_next_tile             = { 0 };
+    uint32_t              m_total_samples_to_bake = 0;
+    dw::Task*             m_bake_parent_task      = nullptr;
+    BakeCheckpoint        m_checkpoint;
+    dw::ThreadPool        m_thread_pool;
+};
@@ -1,34 +1,27 @@
 #define _USE_MATH_DEFINES
-#include <thread_pool.hpp>
 #include <application.h>
-#include <mesh.h>
 #include <camera.h>
-#include <material.h>
+#include <algorithm>
 #include <memory>
 #include <iostream>
 #include <stack>
 #include <random>
 #include <chrono>
-#include <random>
-#include <rtccore.h>
-#include <rtcore_geometry.h>
-#include <rtcore_common.h>
-#include <rtcore_ray.h>
-#include <rtcore_device.h>
-#include <rtcore_scene.h>
-#include <xatlas.h>
 #include "skybox.h"
+#include "lightmap_baker.h"
+#include "headless.h"
 
 #undef min
 #define CAMERA_FAR_PLANE 200.0f
 #define DEBUG_CAMERA_FAR_PLANE 10000.0f
-#define LIGHTMAP_TEXTURE_SIZE 1024
-#define LIGHTMAP_CHART_PADDING 6
-#define LIGHTMAP_SPP 1
-#define LIGHTMAP_BOUNCES 2
 #define SHADOW_MAP_SIZE 1024
 #define LIGHT_FAR_PLANE 650.0f
 #define SHADOW_MAP_EXTENTS 75.0f
+#define BAKE_CACHE_PATH "lightmap.cache"
+#define BAKE_REPORT_PATH "bake_report.json"
+#define UNWRAP_CACHE_PATH "lightmap_unwrap.cache"
+#define SCENE_PATH "mesh/GI_Test_Scene.obj"
+#define SCENE_BINARY_PATH "mesh/GI_Test_Scene" SCENE_FILE_EXTENSION
 
 struct GlobalUniforms
 {
@@ -40,49 +33,15 @@ struct GlobalUniforms
     glm::vec4 cam_pos;
 };
 
-struct LightmapSubMesh
-{
-    uint32_t  index_count;
-    uint32_t  base_vertex;
-    uint32_t  base_index;
-    glm::vec3 max_extents;
-    glm::vec3 min_extents;
-    glm::vec3 color;
-};
-
-struct LightmapVertex
-{
-    glm::vec3 position;
-    glm::vec2 uv;
-    glm::vec2 lightmap_uv;
-    glm::vec3 normal;
-    glm::vec3 tangent;
-    glm::vec3 bitangent;
-};
-
 struct LightmapMesh
 {
     std::vector<LightmapSubMesh>      submeshes;
     std::vector<glm::vec3>            submesh_colors;
-    std::vector<glm::vec3>            vertex_colors;
     std::unique_ptr<dw::VertexBuffer> vbo;
     std::unique_ptr<dw::IndexBuffer>  ibo;
     std::unique_ptr<dw::VertexArray>  vao;
 };
 
-struct BakePoint
-{
-    glm::vec3  position;
-    glm::vec3  direction;
-    glm::ivec2 coord;
-};
-
-struct BakeTaskArgs
-{
-    uint32_t start_idx = 0;
-    uint32_t end_idx   = 0;
-};
-
 class PrecomputedGI : public dw::Application
 {
 protected:
@@ -92,10 +51,7 @@ protected:
     {
         m_distribution = std::uniform_real_distribution<float>(0.0f, 0.9999999f);
 
-        m_light_target              = glm::vec3(0.0f);
-        glm::vec3 default_light_dir = glm::normalize(glm::vec3(0.0f, 0.9770f, 0.5000f));
-        m_light_direction           = -default_light_dir;
-        m_light_color               = glm::vec3(10000.0f);
+        m_light_target = glm::vec3(0.0f);
 
         // Create GPU resources.
         if (!create_shaders())
@@ -106,11 +62,14 @@ protected:
             return false;
 
         create_textures();
-        create_lightmap_buffers();
         initialize_lightmap();
 
-        if (!m_skybox.initialize(default_light_dir, glm::vec3(0.5f), 2.0f))
-            return false;
+        {
+            ScopedPhaseTimer timer(m_baker.m_stats, BAKE_PHASE_SKY);
+
+            if (!m_skybox.initialize(-m_baker.m_light_direction, glm::vec3(0.5f), 2.0f, true, &m_baker.m_thread_pool))
+                return false;
+        }
 
         if (!load_cached_lightmap())
             bake_lightmap();
@@ -172,9 +131,6 @@ protected:
 
     void shutdown() override
     {
-        rtcReleaseGeometry(m_embree_triangle_mesh);
-        rtcReleaseScene(m_embree_scene);
-        rtcReleaseDevice(m_embree_device);
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
@@ -271,8 +227,15 @@ private:
 
     void gui()
     {
-        if (ImGui::Checkbox("Conservative Rasterization", &m_enable_conservative_raster))
-            initialize_lightmap();
+        // Both rebuild the bake points and tiles, which the bake tasks index while they run.
+        if (!m_bake_in_progress)
+        {
+            if (ImGui::Checkbox("Conservative Rasterization", &m_enable_conservative_raster))
+                initialize_lightmap();
+
+            if (ImGui::Checkbox("Spatial Bake Order", &m_baker.m_spatial_order))
+                initialize_lightmap();
+        }
 
         if (ImGui::Checkbox("Bilinear Filtering", &m_bilinear_filtering))
         {
@@ -296,160 +259,108 @@ private:
         {
             ImGui::Checkbox("Hightlight Submeshes", &m_highlight_submeshes);
             ImGui::Checkbox("Hightlight Wireframe", &m_highlight_wireframe);
-        }
-
-        if (ImGui::InputFloat3("Light Direction", &m_light_direction.x))
-            m_skybox.initialize(-m_light_direction, glm::vec3(0.5f), 2.0f);
-
-        ImGui::SliderFloat("Ambient Intensity", &m_ambient_intensity, 0.0f, 1.0f);
-        ImGui::InputFloat("Bias", &m_shadow_bias);
-        ImGui::InputFloat("Offset", &m_offset);
-        ImGui::InputInt("Num Samples", &m_num_samples);
-        ImGui::InputInt("Num Bounces", &m_num_bounces);
 
-        if (ImGui::Button("Bake"))
-            bake_lightmap();
-
-        if (m_bake_in_progress)
-        {
-            uint32_t progress = m_baking_progress;
-
-            ImGui::ProgressBar(float(progress) / float(m_total_samples_to_bake), ImVec2(0.0f, 0.0f));
-            ImGui::SameLine(0.0f, ImGui::GetStyle().ItemInnerSpacing.x);
-            ImGui::Text("Baking Progress");
+            if (ImGui::Checkbox("Convergence Heat Map", &m_convergence_heat_map) && m_convergence_heat_map)
+                update_convergence_texture();
         }
-    }
 
-    // -----------------------------------------------------------------------------------------------------------------------------------
-
-    void initialize_lightmap()
-    {
-        std::unique_ptr<dw::Texture2D> pos_texture            = std::make_unique<dw::Texture2D>(m_lightmap_size, m_lightmap_size, 1, 1, 1, GL_RGBA32F, GL_RGBA, GL_FLOAT);
-        std::unique_ptr<dw::Texture2D> normal_texture         = std::make_unique<dw::Texture2D>(m_lightmap_size, m_lightmap_size, 1, 1, 1, GL_RGBA32F, GL_RGBA, GL_FLOAT);
-        std::unique_ptr<dw::Texture2D> pos_dilated_texture    = std::make_unique<dw::Texture2D>(m_lightmap_size, m_lightmap_size, 1, 1, 1, GL_RGBA32F, GL_RGBA, GL_FLOAT);
-        std::unique_ptr<dw::Texture2D> normal_dilated_texture = std::make_unique<dw::Texture2D>(m_lightmap_size, m_lightmap_size, 1, 1, 1, GL_RGBA32F, GL_RGBA, GL_FLOAT);
+        // Editable between bakes only, like the other bake settings, so the sky always matches the light direction.
+        if (!m_bake_in_progress && ImGui::InputFloat3("Light Direction", &m_baker.m_light_direction.x))
+        {
+            // Only the latest sky update belongs to the next bake.
+            m_baker.m_stats.phase_seconds[BAKE_PHASE_SKY] = 0.0;
 
-        pos_texture->set_wrapping(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
-        pos_dilated_texture->set_wrapping(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
-        normal_texture->set_wrapping(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
-        normal_dilated_texture->set_wrapping(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+            {
+                ScopedPhaseTimer timer(m_baker.m_stats, BAKE_PHASE_SKY);
+                m_skybox.set_sun_dir(-m_baker.m_light_direction);
+            }
 
-        std::unique_ptr<dw::Framebuffer> gbuffer_fbo        = std::make_unique<dw::Framebuffer>();
-        std::unique_ptr<dw::Framebuffer> pos_dilated_fbo    = std::make_unique<dw::Framebuffer>();
-        std::unique_ptr<dw::Framebuffer> normal_dilated_fbo = std::make_unique<dw::Framebuffer>();
+            // Paths recorded by the last bake only need new shadow rays, which is cheap enough to do on every edit.
+            if (m_baker.has_relight_cache())
+                relight_lightmap();
+        }
 
-        dw::Texture* textures[] = { pos_texture.get(), normal_texture.get() };
-        gbuffer_fbo->attach_multiple_render_targets(2, textures);
-        pos_dilated_fbo->attach_render_target(0, pos_dilated_texture.get(), 0, 0);
-        normal_dilated_fbo->attach_render_target(0, normal_dilated_texture.get(), 0, 0);
+        ImGui::SliderFloat("Ambient Intensity", &m_ambient_intensity, 0.0f, 1.0f);
+        ImGui::InputFloat("Bias", &m_shadow_bias);
+        ImGui::Checkbox("Denoise", &m_baker.m_denoise);
 
-        if (m_enable_conservative_raster)
+        // The bake tasks read these settings while they run, so they are only editable between bakes.
+        if (!m_bake_in_progress)
         {
-            if (GLAD_GL_NV_conservative_raster)
-                glEnable(GL_CONSERVATIVE_RASTERIZATION_NV);
-            else if (GLAD_GL_INTEL_conservative_rasterization)
-                glEnable(GL_INTEL_conservative_rasterization);
-        }
+            ImGui::InputFloat("Offset", &m_baker.m_offset);
 
-        glDisable(GL_DEPTH_TEST);
-        glDisable(GL_BLEND);
+            if (ImGui::InputInt("Num Samples", &m_baker.m_num_samples))
+                m_baker.m_num_samples = std::max(1, m_baker.m_num_samples);
 
-        glDisable(GL_CULL_FACE);
+            ImGui::InputInt("Num Bounces", &m_baker.m_num_bounces);
+            ImGui::Checkbox("Stream Tracing", &m_baker.m_stream_tracing);
+            ImGui::Checkbox("Sky Importance Sampling", &m_baker.m_sky_sampling);
+            ImGui::Checkbox("Record Relight Cache", &m_baker.m_record_relight);
+            ImGui::Checkbox("Adaptive Sampling", &m_baker.m_adaptive_sampling);
+            ImGui::InputInt("Checkpoint Interval (s)", &m_baker.m_checkpoint_interval);
 
-        gbuffer_fbo->bind();
+            if (m_baker.m_adaptive_sampling)
+            {
+                if (ImGui::InputInt("Max Samples", &m_baker.m_max_samples))
+                    m_baker.m_max_samples = std::max(1, m_baker.m_max_samples);
 
-        glViewport(0, 0, m_lightmap_size, m_lightmap_size);
+                ImGui::InputFloat("Error Threshold", &m_baker.m_error_threshold);
+            }
 
-        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
+            if (ImGui::Button("Bake"))
+                bake_lightmap();
 
-        // Bind shader program.
-        m_lightmap_program->use();
+            ImGui::SameLine();
 
-        // Bind vertex array.
-        m_unwrapped_mesh.vao->bind();
+            // Keeps accumulating on top of the current result, e.g. one loaded from the bake cache, or finishes the
+            // bake a checkpoint was written by.
+            if (ImGui::Button("Add Samples"))
+                bake_lightmap(true);
+        }
 
-        for (uint32_t i = 0; i < m_unwrapped_mesh.submeshes.size(); i++)
+        if (m_baker.has_relight_cache() && !m_bake_in_progress)
         {
-            LightmapSubMesh& submesh = m_unwrapped_mesh.submeshes[i];
+            ImGui::SameLine();
 
-            // Issue draw call.
-            glDrawElementsBaseVertex(GL_TRIANGLES, submesh.index_count, GL_UNSIGNED_INT, (void*)(sizeof(unsigned int) * submesh.base_index), submesh.base_vertex);
+            if (ImGui::Button("Relight"))
+                relight_lightmap();
         }
 
-        if (m_enable_conservative_raster)
+        if (m_bake_in_progress)
         {
-            if (GLAD_GL_NV_conservative_raster)
-                glDisable(GL_CONSERVATIVE_RASTERIZATION_NV);
-            else if (GLAD_GL_INTEL_conservative_rasterization)
-                glDisable(GL_INTEL_conservative_rasterization);
-        }
-
-        glFinish();
-
-        // Dilate
-        dilate(pos_texture, pos_dilated_fbo.get());
-        dilate(normal_texture, normal_dilated_fbo.get());
-
-        glFinish();
-
-        std::vector<glm::vec4> ray_positions;
-        std::vector<glm::vec4> ray_directions;
+            uint32_t progress = m_baker.m_baking_progress;
 
-        ray_positions.resize(m_lightmap_size * m_lightmap_size);
-        ray_directions.resize(m_lightmap_size * m_lightmap_size);
-
-        // Copy bake sample points
-        GL_CHECK_ERROR(glActiveTexture(GL_TEXTURE0));
-        GL_CHECK_ERROR(glBindTexture(pos_dilated_texture->target(), pos_dilated_texture->id()));
-        GL_CHECK_ERROR(glGetTexImage(pos_dilated_texture->target(), 0, pos_dilated_texture->format(), pos_dilated_texture->type(), ray_positions.data()));
-
-        GL_CHECK_ERROR(glBindTexture(normal_dilated_texture->target(), normal_dilated_texture->id()));
-        GL_CHECK_ERROR(glGetTexImage(normal_dilated_texture->target(), 0, normal_dilated_texture->format(), normal_dilated_texture->type(), ray_directions.data()));
-        GL_CHECK_ERROR(glBindTexture(normal_dilated_texture->target(), 0));
-
-        glFinish();
-
-        for (int y = 0; y < m_lightmap_size; y++)
+            ImGui::ProgressBar(float(progress) / float(m_baker.m_total_samples_to_bake), ImVec2(0.0f, 0.0f));
+            ImGui::SameLine(0.0f, ImGui::GetStyle().ItemInnerSpacing.x);
+            ImGui::Text("Baking Progress");
+        }
+        else if (ImGui::TreeNode("Bake Statistics"))
         {
-            for (int x = 0; x < m_lightmap_size; x++)
-            {
-                glm::vec3 normal   = ray_directions[m_lightmap_size * y + x];
-                glm::vec3 position = ray_positions[m_lightmap_size * y + x];
-
-                // Check if this is a valid lightmap texel
-                if (valid_texel(normal))
-                    m_bake_points.push_back({ position, normal, { x, y } });
-            }
+            const BakeStats&    stats    = m_baker.m_stats;
+            const BakeCounters& counters = stats.counters;
+            const double        seconds  = stats.phase_seconds[BAKE_PHASE_BAKE];
+
+            for (int i = 0; i < BAKE_PHASE_COUNT; i++)
+                ImGui::Text("%-13s %10.2f ms", bake_phase_name(BakePhase(i)), stats.phase_seconds[i] * 1000.0);
+
+            ImGui::Text("%-13s %10.2f ms", "total", stats.total_seconds() * 1000.0);
+            ImGui::Separator();
+            ImGui::Text("Paths: %llu", (unsigned long long)counters.paths);
+            ImGui::Text("Rays: %llu", (unsigned long long)counters.rays);
+            ImGui::Text("Shadow Rays: %llu", (unsigned long long)counters.shadow_rays);
+            ImGui::Text("Sky Escapes: %llu", (unsigned long long)counters.sky_escapes);
+            ImGui::Text("Gutter Texels: %llu", (unsigned long long)counters.gutter_texels);
+            ImGui::Text("Average Path Length: %.2f", counters.paths > 0 ? double(counters.rays) / double(counters.paths) : 0.0);
+            ImGui::Text("Rays/s: %.2f M", seconds > 0.0 ? double(counters.rays + counters.shadow_rays) / seconds * 1e-6 : 0.0);
+            ImGui::TreePop();
         }
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
-    void dilate(std::unique_ptr<dw::Texture2D>& tex, dw::Framebuffer* fbo)
-    {
-        fbo->bind();
-
-        glViewport(0, 0, m_lightmap_size, m_lightmap_size);
-
-        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
-
-        // Bind shader program.
-        m_dilate_program->use();
-
-        if (m_dilate_program->set_uniform("s_Texture", 0))
-            tex->bind(0);
-
-        // Render fullscreen triangle
-        glDrawArrays(GL_TRIANGLES, 0, 3);
-    }
-
-    // -----------------------------------------------------------------------------------------------------------------------------------
-
-    void create_lightmap_buffers()
+    void initialize_lightmap()
     {
-        m_framebuffer.resize(m_lightmap_size * m_lightmap_size);
+        m_baker.initialize_bake_points(m_enable_conservative_raster);
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
@@ -491,7 +402,6 @@ private:
     {
         {
             // Create general shaders
-            m_lightmap_fs            = std::unique_ptr<dw::Shader>(dw::Shader::create_from_file(GL_FRAGMENT_SHADER, "shader/lightmap_fs.glsl"));
             m_mesh_vs                = std::unique_ptr<dw::Shader>(dw::Shader::create_from_file(GL_VERTEX_SHADER, "shader/mesh_vs.glsl"));
             m_shadow_map_vs          = std::unique_ptr<dw::Shader>(dw::Shader::create_from_file(GL_VERTEX_SHADER, "shader/shadow_map_vs.glsl"));
             m_mesh_fs                = std::unique_ptr<dw::Shader>(dw::Shader::create_from_file(GL_FRAGMENT_SHADER, "shader/mesh_fs.glsl"));
@@ -499,27 +409,8 @@ private:
             m_lightmap_vs            = std::unique_ptr<dw::Shader>(dw::Shader::create_from_file(GL_VERTEX_SHADER, "shader/lightmap_vs.glsl"));
             m_visualize_lightmap_fs  = std::unique_ptr<dw::Shader>(dw::Shader::create_from_file(GL_FRAGMENT_SHADER, "shader/visualize_lightmap_fs.glsl"));
             m_visualize_submeshes_fs = std::unique_ptr<dw::Shader>(dw::Shader::create_from_file(GL_FRAGMENT_SHADER, "shader/visualize_submeshes_fs.glsl"));
-            m_dilate_fs              = std::unique_ptr<dw::Shader>(dw::Shader::create_from_file(GL_FRAGMENT_SHADER, "shader/dilate_fs.glsl"));
             m_depth_fs               = std::unique_ptr<dw::Shader>(dw::Shader::create_from_file(GL_FRAGMENT_SHADER, "shader/depth_fs.glsl"));
 
-            {
-                if (!m_lightmap_vs || !m_lightmap_fs)
-                {
-                    DW_LOG_FATAL("Failed to create Shaders");
-                    return false;
-                }
-
-                // Create general shader program
-                dw::Shader* shaders[] = { m_lightmap_vs.get(), m_lightmap_fs.get() };
-                m_lightmap_program    = std::make_unique<dw::Program>(2, shaders);
-
-                if (!m_lightmap_program)
-                {
-                    DW_LOG_FATAL("Failed to create Shader Program");
-                    return false;
-                }
-            }
-
             {
                 if (!m_lightmap_vs || !m_visualize_submeshes_fs)
                 {
@@ -559,24 +450,6 @@ private:
                 m_shadow_map_program->uniform_block_binding("CSMUniforms", 1);
             }
 
-            {
-                if (!m_triangle_vs || !m_dilate_fs)
-                {
-                    DW_LOG_FATAL("Failed to create Shaders");
-                    return false;
-                }
-
-                // Create general shader program
-                dw::Shader* shaders[] = { m_triangle_vs.get(), m_dilate_fs.get() };
-                m_dilate_program      = std::make_unique<dw::Program>(2, shaders);
-
-                if (!m_dilate_program)
-                {
-                    DW_LOG_FATAL("Failed to create Shader Program");
-                    return false;
-                }
-            }
-
             {
                 if (!m_triangle_vs || !m_visualize_lightmap_fs)
                 {
@@ -625,10 +498,14 @@ private:
     void create_textures()
     {
         m_shadow_map       = std::make_unique<dw::Texture2D>(SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 1, 1, 1, GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT);
-        m_lightmap_texture = std::make_unique<dw::Texture2D>(m_lightmap_size, m_lightmap_size, 1, 1, 1, GL_RGBA32F, GL_RGBA, GL_FLOAT);
+        m_lightmap_texture = std::make_unique<dw::Texture2D>(m_baker.m_lightmap_size, m_baker.m_lightmap_size, 1, 1, 1, GL_RGBA32F, GL_RGBA, GL_FLOAT);
 
         m_lightmap_texture->set_wrapping(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
 
+        m_convergence_texture = std::make_unique<dw::Texture2D>(m_baker.m_lightmap_size, m_baker.m_lightmap_size, 1, 1, 1, GL_RGBA32F, GL_RGBA, GL_FLOAT);
+        m_convergence_texture->set_wrapping(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+        m_convergence_texture->set_mag_filter(GL_NEAREST);
+
         m_shadow_map_fbo = std::make_unique<dw::Framebuffer>();
         m_shadow_map_fbo->attach_depth_stencil_target(m_shadow_map.get(), 0, 0);
     }
@@ -647,87 +524,56 @@ private:
 
     bool load_scene()
     {
-        dw::Mesh* mesh = dw::Mesh::load("mesh/GI_Test_Scene.obj");
+        Scene scene;
 
-        if (!mesh)
         {
-            DW_LOG_FATAL("Failed to load mesh!");
-            return false;
+            ScopedPhaseTimer timer(m_baker.m_stats, BAKE_PHASE_LOAD_SCENE);
+
+            // The OBJ is only parsed when there is no preprocessed scene file yet or the OBJ or its materials changed
+            // since it was written. The file is then (re)written for the next run.
+            bool loaded = scene.load(SCENE_BINARY_PATH);
+
+            if (!loaded || scene.is_stale())
+            {
+                if (loaded)
+                    DW_LOG_INFO(SCENE_PATH " changed since " SCENE_BINARY_PATH " was written, converting it again");
+
+                if (scene.load(SCENE_PATH))
+                {
+                    if (!scene.write_binary(SCENE_BINARY_PATH))
+                        DW_LOG_ERROR("Failed to write " SCENE_BINARY_PATH);
+                }
+                else if (scene.m_submeshes.empty()) // A stale scene file is kept if the OBJ cannot be opened at all
+                {
+                    DW_LOG_FATAL("Failed to load mesh!");
+                    return false;
+                }
+            }
         }
 
-        if (!lightmap_uv_unwrap(mesh))
-            return false;
+        m_baker.m_unwrap_cache_path = UNWRAP_CACHE_PATH;
+        m_baker.m_checkpoint_path   = BAKE_CACHE_PATH;
 
-        if (!initialize_embree(mesh))
+        if (!m_baker.initialize(scene, &m_skybox))
             return false;
 
-        dw::Mesh::unload(mesh);
-
-        return true;
+        return create_lightmap_uv_unwrapped_mesh();
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
-    bool create_lightmap_uv_unwrapped_mesh(xatlas::Atlas* atlas, dw::Mesh* mesh)
+    bool create_lightmap_uv_unwrapped_mesh()
     {
-        dw::Vertex* vertex_ptr = mesh->vertices();
-
-        std::vector<LightmapVertex> vertices;
-        std::vector<uint32_t>       indices;
+        m_unwrapped_mesh.submeshes = m_baker.m_submeshes;
 
-        for (int i = 0; i < mesh->sub_mesh_count(); i++)
-        {
-            LightmapSubMesh sub;
-
-            sub.color       = mesh->sub_meshes()[i].mat->albedo_value();
-            sub.index_count = mesh->sub_meshes()[i].index_count;
-            sub.base_vertex = mesh->sub_meshes()[i].base_vertex;
-            sub.base_index  = mesh->sub_meshes()[i].base_index;
-            sub.max_extents = mesh->sub_meshes()[i].max_extents;
-            sub.min_extents = mesh->sub_meshes()[i].min_extents;
-
-            m_unwrapped_mesh.submeshes.push_back(sub);
+        for (int i = 0; i < m_unwrapped_mesh.submeshes.size(); i++)
             m_unwrapped_mesh.submesh_colors.push_back(glm::vec3(drand48(), drand48(), drand48()));
-        }
-
-        uint32_t index_count  = 0;
-        uint32_t vertex_count = 0;
-
-        for (int mesh_idx = 0; mesh_idx < atlas->meshCount; mesh_idx++)
-        {
-            LightmapSubMesh& sub = m_unwrapped_mesh.submeshes[mesh_idx];
-
-            sub.base_index  = index_count;
-            sub.base_vertex = vertex_count;
-
-            for (int i = 0; i < atlas->meshes[mesh_idx].vertexCount; i++)
-            {
-                int idx = atlas->meshes[mesh_idx].vertexArray[i].xref;
-
-                LightmapVertex v;
-
-                v.position    = vertex_ptr[idx].position;
-                v.uv          = vertex_ptr[idx].tex_coord;
-                v.normal      = vertex_ptr[idx].normal;
-                v.tangent     = vertex_ptr[idx].tangent;
-                v.bitangent   = vertex_ptr[idx].bitangent;
-                v.lightmap_uv = glm::vec2(atlas->meshes[mesh_idx].vertexArray[i].uv[0] / (atlas->width - 1), atlas->meshes[mesh_idx].vertexArray[i].uv[1] / (atlas->height - 1));
-
-                vertices.push_back(v);
-            }
-
-            for (int i = 0; i < atlas->meshes[mesh_idx].indexCount; i++)
-                indices.push_back(atlas->meshes[mesh_idx].indexArray[i]);
-
-            index_count += atlas->meshes[mesh_idx].indexCount;
-            vertex_count += atlas->meshes[mesh_idx].vertexCount;
-        }
 
         // Create vertex buffer.
-        m_unwrapped_mesh.vbo = std::make_unique<dw::VertexBuffer>(GL_STATIC_DRAW, sizeof(LightmapVertex) * vertices.size(), vertices.data());
+        m_unwrapped_mesh.vbo = std::make_unique<dw::VertexBuffer>(GL_STATIC_DRAW, sizeof(LightmapVertex) * m_baker.m_vertices.size(), m_baker.m_vertices.data());
 
         // Create index buffer.
-        m_unwrapped_mesh.ibo = std::make_unique<dw::IndexBuffer>(GL_STATIC_DRAW, sizeof(uint32_t) * indices.size(), indices.data());
+        m_unwrapped_mesh.ibo = std::make_unique<dw::IndexBuffer>(GL_STATIC_DRAW, sizeof(uint32_t) * m_baker.m_indices.size(), m_baker.m_indices.data());
 
         // Declare vertex attributes.
         dw::VertexAttrib attribs[] = { { 3, GL_FLOAT, false, 0 },
@@ -745,128 +591,6 @@ private:
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
-    bool lightmap_uv_unwrap(dw::Mesh* mesh)
-    {
-        std::vector<glm::vec3> positions(mesh->vertex_count());
-        std::vector<glm::vec3> normals(mesh->vertex_count());
-        std::vector<glm::vec2> uvs(mesh->vertex_count());
-
-        xatlas::Atlas* atlas = xatlas::Create();
-
-        int         idx        = 0;
-        dw::Vertex* vertex_ptr = mesh->vertices();
-        uint32_t*   index_ptr  = mesh->indices();
-
-        for (int i = 0; i < mesh->vertex_count(); i++)
-        {
-            positions[i] = vertex_ptr[i].position;
-            normals[i]   = vertex_ptr[i].normal;
-            uvs[i]       = vertex_ptr[i].tex_coord;
-        }
-
-        for (int mesh_idx = 0; mesh_idx < mesh->sub_mesh_count(); mesh_idx++)
-        {
-            dw::SubMesh& submesh = mesh->sub_meshes()[mesh_idx];
-
-            xatlas::MeshDecl mesh_decl;
-
-            mesh_decl.vertexCount          = mesh->vertex_count();
-            mesh_decl.vertexPositionStride = sizeof(glm::vec3);
-            mesh_decl.vertexPositionData   = &positions[0];
-            mesh_decl.vertexNormalStride   = sizeof(glm::vec3);
-            mesh_decl.vertexNormalData     = &normals[0];
-            mesh_decl.vertexUvStride       = sizeof(glm::vec2);
-            mesh_decl.vertexUvData         = &uvs[0];
-            mesh_decl.indexCount           = submesh.index_count;
-            mesh_decl.indexData            = &mesh->indices()[submesh.base_index];
-            mesh_decl.indexOffset          = submesh.base_vertex;
-            mesh_decl.indexFormat          = xatlas::IndexFormat::UInt32;
-
-            xatlas::AddMeshError::Enum error = xatlas::AddMesh(atlas, mesh_decl);
-
-            if (error != xatlas::AddMeshError::Success)
-            {
-                xatlas::Destroy(atlas);
-                DW_LOG_ERROR("Failed to add UV mesh to Lightmap Atlas");
-                return false;
-            }
-        }
-
-        xatlas::ComputeCharts(atlas);
-        xatlas::ParameterizeCharts(atlas);
-
-        xatlas::PackOptions pack_options;
-
-        pack_options.padding    = LIGHTMAP_CHART_PADDING;
-        pack_options.resolution = m_lightmap_size;
-
-        xatlas::PackCharts(atlas, pack_options);
-
-        bool status = create_lightmap_uv_unwrapped_mesh(atlas, mesh);
-        xatlas::Destroy(atlas);
-
-        return status;
-    }
-
-    // -----------------------------------------------------------------------------------------------------------------------------------
-
-    bool initialize_embree(dw::Mesh* mesh)
-    {
-        m_embree_device = rtcNewDevice(nullptr);
-
-        RTCError embree_error = rtcGetDeviceError(m_embree_device);
-
-        if (embree_error == RTC_ERROR_UNSUPPORTED_CPU)
-            throw std::runtime_error("Your CPU does not meet the minimum requirements for embree");
-        else if (embree_error != RTC_ERROR_NONE)
-            throw std::runtime_error("Failed to initialize embree!");
-
-        m_embree_scene = rtcNewScene(m_embree_device);
-
-        rtcSetSceneFlags(m_embree_scene, RTC_SCENE_FLAG_ROBUST);
-
-        m_embree_triangle_mesh = rtcNewGeometry(m_embree_device, RTC_GEOMETRY_TYPE_TRIANGLE);
-
-        std::vector<glm::vec3> vertices(mesh->vertex_count());
-
-        m_unwrapped_mesh.vertex_colors.resize(mesh->index_count() / 3);
-
-        std::vector<uint32_t> indices(mesh->index_count());
-        uint32_t              idx        = 0;
-        dw::Vertex*           vertex_ptr = mesh->vertices();
-        uint32_t*             index_ptr  = mesh->indices();
-
-        for (int i = 0; i < mesh->vertex_count(); i++)
-            vertices[i] = vertex_ptr[i].position;
-
-        uint32_t tri_idx = 0;
-
-        for (int i = 0; i < mesh->sub_mesh_count(); i++)
-        {
-            dw::SubMesh& submesh = mesh->sub_meshes()[i];
-
-            for (int j = submesh.base_index; j < (submesh.base_index + submesh.index_count); j++)
-                indices[idx++] = submesh.base_vertex + index_ptr[j];
-
-            for (int j = 0; j < (submesh.index_count / 3); j++)
-                m_unwrapped_mesh.vertex_colors[tri_idx++] = submesh.mat->albedo_value();
-        }
-
-        void* data = rtcSetNewGeometryBuffer(m_embree_triangle_mesh, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT3, sizeof(glm::vec3), mesh->vertex_count());
-        memcpy(data, vertices.data(), vertices.size() * sizeof(glm::vec3));
-
-        data = rtcSetNewGeometryBuffer(m_embree_triangle_mesh, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT3, 3 * sizeof(uint32_t), mesh->index_count() / 3);
-        memcpy(data, indices.data(), indices.size() * sizeof(uint32_t));
-
-        rtcCommitGeometry(m_embree_triangle_mesh);
-        rtcAttachGeometry(m_embree_scene, m_embree_triangle_mesh);
-        rtcCommitScene(m_embree_scene);
-
-        return true;
-    }
-
-    // -----------------------------------------------------------------------------------------------------------------------------------
-
     void create_camera()
     {
         m_main_camera = std::make_unique<dw::Camera>(60.0f, 0.1f, CAMERA_FAR_PLANE, float(m_width) / float(m_height), glm::vec3(50.0f, 20.0f, 0.0f), glm::vec3(-1.0f, 0.0, 0.0f));
@@ -898,8 +622,8 @@ private:
             program->set_uniform("u_Roughness", m_roughness);
             program->set_uniform("u_Metallic", m_metallic);
             program->set_uniform("u_Color", submesh.color);
-            program->set_uniform("u_Direction", m_light_direction);
-            program->set_uniform("u_LightColor", m_light_color);
+            program->set_uniform("u_Direction", m_baker.m_light_direction);
+            program->set_uniform("u_LightColor", m_baker.m_light_color);
             program->set_uniform("u_IndirectLighting", (int)m_indirect_lighting);
             program->set_uniform("u_AmbientIntensity", m_ambient_intensity);
 
@@ -964,7 +688,12 @@ private:
         m_visualize_lightmap_program->use();
 
         if (m_visualize_lightmap_program->set_uniform("s_Lightmap", 0))
-            m_lightmap_dilated_texture->bind(0);
+        {
+            if (m_convergence_heat_map)
+                m_convergence_texture->bind(0);
+            else
+                m_lightmap_dilated_texture->bind(0);
+        }
 
         // Render fullscreen triangle
         glDrawArrays(GL_TRIANGLES, 0, 3);
@@ -1026,316 +755,126 @@ private:
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
-    glm::vec3 diffuse_lambert(glm::vec3 albedo)
-    {
-        return albedo;
-    }
-
-    // -----------------------------------------------------------------------------------------------------------------------------------
-
-    bool valid_texel(glm::vec3 t)
+    // Only succeeds if the cache was baked from the same scene and settings, anything else needs a new bake.
+    bool load_cached_lightmap()
     {
-        return !(t.x == 0.0f && t.y == 0.0f && t.z == 0.0f);
-    }
+        m_lightmap_dilated_texture = std::make_unique<dw::Texture2D>(m_baker.m_lightmap_size, m_baker.m_lightmap_size, 1, 1, 1, GL_RGBA32F, GL_RGBA, GL_FLOAT);
+        m_lightmap_dilated_texture->set_wrapping(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
 
-    // -----------------------------------------------------------------------------------------------------------------------------------
-
-    void clear_lightmap()
-    {
-        for (int y = 0; y < m_lightmap_size; y++)
-        {
-            for (int x = 0; x < m_lightmap_size; x++)
-                m_framebuffer[m_lightmap_size * y + x] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
-        }
-    }
+        if (!m_baker.load_bake_cache(BAKE_CACHE_PATH))
+            return false;
 
-    // -----------------------------------------------------------------------------------------------------------------------------------
+        update_lightmap_textures();
 
-    bool is_nan(glm::vec3 v)
-    {
-        glm::bvec3 b = glm::isnan(v);
-        return b.x || b.y || b.z;
+        return true;
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
-    glm::mat3 make_rotation_matrix(glm::vec3 z)
+    void write_lightmap(const std::vector<glm::vec4>& lightmap)
     {
-        const glm::vec3 ref = glm::abs(glm::dot(z, glm::vec3(0, 1, 0))) > 0.99f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+        ScopedPhaseTimer timer(m_baker.m_stats, BAKE_PHASE_WRITE);
 
-        const glm::vec3 x = glm::normalize(glm::cross(ref, z));
-        const glm::vec3 y = glm::cross(z, x);
-
-        assert(!is_nan(x));
-        assert(!is_nan(y));
-        assert(!is_nan(z));
-
-        return { x, y, z };
+        if (!write_lightmap_hdr("lightmap.hdr", lightmap.data(), m_baker.m_lightmap_size))
+            DW_LOG_ERROR("Failed to write lightmap.hdr");
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
-#undef max
-
-    glm::vec3 sample_cosine_lobe_direction(glm::vec3 n)
+    void finish_bake()
     {
-        glm::vec2 sample = glm::max(glm::vec2(0.00001f), glm::vec2(drand48(), drand48()));
-
-        const float phi = 2.0f * M_PI * sample.y;
-
-        const float cos_theta = sqrt(sample.x);
-        const float sin_theta = sqrt(1 - sample.x);
-
-        glm::vec3 t = glm::vec3(sin_theta * cos(phi), sin_theta * sin(phi), cos_theta);
+        if (m_bake_in_progress)
+        {
+            if (m_baker.is_done())
+            {
+                m_bake_in_progress = false;
 
-        assert(!is_nan(t));
+                // Stops the checkpoint thread before the final cache replaces its last checkpoint.
+                m_baker.wait();
 
-        return glm::normalize(make_rotation_matrix(n) * t);
-    }
+                std::vector<glm::vec4> dilated = update_lightmap_textures();
 
-    // -----------------------------------------------------------------------------------------------------------------------------------
+                write_lightmap(dilated);
 
-    void create_ray(glm::vec3 direction, glm::vec3 position, RTCRayHit& rayhit)
-    {
-        rayhit.ray.dir_x = direction.x;
-        rayhit.ray.dir_y = direction.y;
-        rayhit.ray.dir_z = direction.z;
-
-        rayhit.ray.org_x = position.x;
-        rayhit.ray.org_y = position.y;
-        rayhit.ray.org_z = position.z;
-
-        rayhit.ray.tnear     = 0;
-        rayhit.ray.tfar      = INFINITY;
-        rayhit.ray.mask      = -1;
-        rayhit.ray.flags     = 0;
-        rayhit.hit.geomID    = RTC_INVALID_GEOMETRY_ID;
-        rayhit.hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
-    }
+                if (!m_baker.save_bake_cache(BAKE_CACHE_PATH))
+                    DW_LOG_ERROR("Failed to write " BAKE_CACHE_PATH);
 
-    // -----------------------------------------------------------------------------------------------------------------------------------
+                if (!m_baker.write_bake_report(BAKE_REPORT_PATH, SCENE_PATH))
+                    DW_LOG_ERROR("Failed to write " BAKE_REPORT_PATH);
+            }
+            else
+            {
+                m_baker.scatter_framebuffer();
+                m_lightmap_texture->set_data(0, 0, m_baker.m_framebuffer.data());
+            }
 
-    bool is_triangle_back_facing(glm::vec3 n, glm::vec3 d)
-    {
-        return glm::dot(n, d) > 0.0f;
+            if (m_convergence_heat_map)
+                update_convergence_texture();
+        }
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
-    glm::vec3 evaluate_direct_lighting(RTCIntersectContext& context, glm::vec3 p, glm::vec3 n, glm::vec3 albedo)
+    // Uploads the current bake result, denoised if enabled, and returns its dilated version.
+    std::vector<glm::vec4> update_lightmap_textures()
     {
-        const glm::vec3 l  = -m_light_direction;
-        const glm::vec3 li = m_light_color;
-
-        RTCRay rayhit;
-
-        rayhit.dir_x = l.x;
-        rayhit.dir_y = l.y;
-        rayhit.dir_z = l.z;
-
-        rayhit.org_x = p.x;
-        rayhit.org_y = p.y;
-        rayhit.org_z = p.z;
-
-        rayhit.tnear = 0;
-        rayhit.tfar  = INFINITY;
-        rayhit.mask  = -1;
-        rayhit.flags = 0;
+        m_baker.scatter_framebuffer();
 
-        rtcOccluded1(m_embree_scene, &context, &rayhit);
+        std::vector<glm::vec4> lightmap = m_baker.m_framebuffer;
 
-        // Is it visible?
-        if (rayhit.tfar == INFINITY)
-            return li * diffuse_lambert(albedo) * glm::max(glm::dot(n, l), 0.0f);
+        if (m_baker.m_denoise && !m_baker.denoise(lightmap))
+            DW_LOG_ERROR("Failed to denoise lightmap");
 
-        return glm::vec3(0.0f);
-    }
-
-    // -----------------------------------------------------------------------------------------------------------------------------------
-
-    glm::vec3 path_trace(glm::vec3 direction, glm::vec3 position, bool& gutter)
-    {
-        glm::vec3 color;
-        RTCRayHit rayhit;
+        m_lightmap_texture->set_data(0, 0, lightmap.data());
 
-        glm::vec3 p = position;
-        glm::vec3 n = direction;
-        glm::vec3 d = direction;
+        std::vector<glm::vec4> dilated(lightmap.size());
 
-        p += n * m_offset;
-
-        color                 = glm::vec3(0.0f);
-        glm::vec3 attenuation = glm::vec3(1.0f);
-
-        for (int i = 0; i < m_num_bounces; i++)
         {
-            RTCIntersectContext intersect_context;
-            rtcInitIntersectContext(&intersect_context);
-
-            d = sample_cosine_lobe_direction(n);
-
-            create_ray(d, p, rayhit);
-
-            rtcIntersect1(m_embree_scene, &intersect_context, &rayhit);
-
-            // Does intersect scene
-            if (rayhit.hit.geomID == RTC_INVALID_GEOMETRY_ID)
-            {
-                float sky_dir = d.y < 0.0f ? 0.0f : 1.0f;
-                return color + m_skybox.sample_sky(d) * sky_dir * attenuation;
-            }
-
-            uint32_t v_idx = rayhit.hit.primID;
-
-            const glm::vec3 albedo = m_unwrapped_mesh.vertex_colors[v_idx];
-
-            p = p + d * rayhit.ray.tfar;
-            n = glm::normalize(glm::vec3(rayhit.hit.Ng_x, rayhit.hit.Ng_y, rayhit.hit.Ng_z));
-
-            if (is_triangle_back_facing(n, d))
-            {
-                if (i == 0)
-                    gutter = true;
-
-                break;
-            }
-            // Add bias to position
-            p += glm::sign(n) * abs(p * 0.0000002f);
-
-            color += evaluate_direct_lighting(intersect_context, p, n, albedo) * attenuation;
-
-            attenuation *= albedo;
+            ScopedPhaseTimer timer(m_baker.m_stats, BAKE_PHASE_DILATE);
+            dilate_lightmap(lightmap.data(), dilated.data(), m_baker.m_lightmap_size);
         }
 
-        return color;
+        m_lightmap_dilated_texture->set_mag_filter(m_bilinear_filtering ? GL_LINEAR : GL_NEAREST);
+        m_lightmap_dilated_texture->set_data(0, 0, dilated.data());
+
+        return dilated;
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
-    bool load_cached_lightmap()
+    void update_convergence_texture()
     {
-        auto ptr = dw::Texture2D::create_from_files("lightmap.hdr");
+        std::vector<glm::vec4> heat_map;
+        m_baker.convergence_heat_map(heat_map);
 
-        if (ptr)
-        {
-            m_lightmap_dilated_texture = std::unique_ptr<dw::Texture2D>(ptr);
-            return true;
-        }
-        else
-        {
-            m_lightmap_dilated_texture = std::make_unique<dw::Texture2D>(m_lightmap_size, m_lightmap_size, 1, 1, 1, GL_RGB32F, GL_RGB, GL_FLOAT);
-            m_lightmap_dilated_texture->set_wrapping(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
-
-            return false;
-        }
+        m_convergence_texture->set_data(0, 0, heat_map.data());
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
-    void write_lightmap()
+    void bake_lightmap(bool resume = false)
     {
-        m_lightmap_dilated_texture->save_to_disk("lightmap", 0, 0);
-    }
-
-    // -----------------------------------------------------------------------------------------------------------------------------------
+        m_baker.m_stats.reset_bake();
+        m_baker.bake(resume);
 
-    void finish_bake()
-    {
-        if (m_bake_in_progress)
-        {
-            if (m_thread_pool.is_done(m_bake_parent_task))
-            {
-                m_bake_in_progress = false;
-
-                m_lightmap_texture->set_data(0, 0, m_framebuffer.data());
-
-                std::unique_ptr<dw::Framebuffer> m_lightmap_dilated_fbo = std::make_unique<dw::Framebuffer>();
-                m_lightmap_dilated_fbo->attach_render_target(0, m_lightmap_dilated_texture.get(), 0, 0);
-
-                dilate(m_lightmap_texture, m_lightmap_dilated_fbo.get());
-
-                glFinish();
-
-                write_lightmap();
-            }
-            else
-                m_lightmap_texture->set_data(0, 0, m_framebuffer.data());
-        }
+        m_bake_in_progress = true;
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
-    void bake_lightmap()
+    void relight_lightmap()
     {
-        glFinish();
-
-        clear_lightmap();
-
-        dw::Task* tasks[16];
-
-        std::function<void(void*)> bake_function = [=](void* data) {
-            BakeTaskArgs* args = (BakeTaskArgs*)data;
-
-            for (int sample = 0; sample < m_num_samples; sample++)
-            {
-                for (int i = args->start_idx; i < args->end_idx; i++)
-                {
-                    glm::vec4 current_color = m_framebuffer[m_lightmap_size * m_bake_points[i].coord.y + m_bake_points[i].coord.x];
-                    glm::vec3 color         = current_color;
-                    glm::vec3 normal        = m_bake_points[i].direction;
-                    glm::vec3 position      = m_bake_points[i].position;
-
-                    bool is_gutter = false;
-                    color += path_trace(normal, position, is_gutter) * m_sample_weight;
-
-                    float alpha = current_color.a;
-
-                    if (is_gutter)
-                        alpha = 0.0f;
+        m_baker.m_stats.reset_bake();
+        m_baker.relight();
 
-                    m_framebuffer[m_lightmap_size * m_bake_points[i].coord.y + m_bake_points[i].coord.x] = glm::vec4(color, alpha);
-                    m_baking_progress++;
-                }
-            }
-        };
-
-        uint32_t points_per_task = ceil(float(m_bake_points.size()) / float(m_thread_pool.num_worker_threads()));
-        uint32_t remaining       = m_bake_points.size();
-
-        m_total_samples_to_bake = m_bake_points.size() * m_num_samples;
-        m_baking_progress       = 0;
-        m_bake_in_progress      = true;
-        m_sample_weight         = 1.0f / float(m_num_samples);
-
-        for (int i = 0; i < m_thread_pool.num_worker_threads(); i++)
-        {
-            tasks[i]           = m_thread_pool.allocate();
-            tasks[i]->function = bake_function;
-
-            BakeTaskArgs* args = dw::task_data<BakeTaskArgs>(tasks[i]);
-
-            args->start_idx = points_per_task * i;
-            args->end_idx   = args->start_idx + (i == (m_thread_pool.num_worker_threads() - 1) ? remaining : points_per_task);
-
-            remaining -= points_per_task;
-
-            if (i != 0)
-            {
-                m_thread_pool.add_as_child(tasks[0], tasks[i]);
-                m_thread_pool.enqueue(tasks[i]);
-            }
-        }
-
-        m_thread_pool.enqueue(tasks[0]);
-
-        m_bake_parent_task = tasks[0];
+        m_bake_in_progress = true;
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
     void update_uniforms()
     {
-        glm::vec3 light_camera_pos = m_light_target - m_light_direction * 200.0f;
+        glm::vec3 light_camera_pos = m_light_target - m_baker.m_light_direction * 200.0f;
         glm::mat4 view             = glm::lookAt(light_camera_pos, m_light_target, glm::vec3(0.0f, 1.0f, 0.0f));
         glm::mat4 proj             = glm::ortho(-SHADOW_MAP_EXTENTS, SHADOW_MAP_EXTENTS, -SHADOW_MAP_EXTENTS, SHADOW_MAP_EXTENTS, 1.0f, LIGHT_FAR_PLANE);
 
@@ -1392,8 +931,6 @@ private:
 
 private:
     // General GPU resources.
-    std::unique_ptr<dw::Shader> m_lightmap_fs;
-    std::unique_ptr<dw::Shader> m_dilate_fs;
     std::unique_ptr<dw::Shader> m_mesh_fs;
     std::unique_ptr<dw::Shader> m_visualize_lightmap_fs;
     std::unique_ptr<dw::Shader> m_visualize_submeshes_fs;
@@ -1404,8 +941,6 @@ private:
     std::unique_ptr<dw::Shader> m_mesh_vs;
     std::unique_ptr<dw::Shader> m_shadow_map_vs;
 
-    std::unique_ptr<dw::Program> m_lightmap_program;
-    std::unique_ptr<dw::Program> m_dilate_program;
     std::unique_ptr<dw::Program> m_visualize_lightmap_program;
     std::unique_ptr<dw::Program> m_visualize_submeshes_program;
     std::unique_ptr<dw::Program> m_mesh_program;
@@ -1415,12 +950,10 @@ private:
     std::unique_ptr<dw::Texture2D>   m_shadow_map;
     std::unique_ptr<dw::Texture2D>   m_lightmap_texture;
     std::unique_ptr<dw::Texture2D>   m_lightmap_dilated_texture;
+    std::unique_ptr<dw::Texture2D>   m_convergence_texture;
 
     std::unique_ptr<dw::UniformBuffer> m_global_ubo;
 
-    std::vector<BakePoint> m_bake_points;
-    std::vector<glm::vec4> m_framebuffer;
-
     // Camera.
     LightmapMesh                m_unwrapped_mesh;
     std::unique_ptr<dw::Camera> m_main_camera;
@@ -1436,33 +969,21 @@ private:
     float m_sideways_speed     = 0.0f;
     float m_camera_sensitivity = 0.05f;
     float m_camera_speed       = 0.05f;
-    float m_offset             = 0.1f;
     bool  m_debug_gui          = true;
 
-    // Lightmap settings
-    int m_num_samples   = LIGHTMAP_SPP;
-    int m_num_bounces   = LIGHTMAP_BOUNCES;
-    int m_lightmap_size = LIGHTMAP_TEXTURE_SIZE;
-
-    // Embree structure
-    RTCDevice   m_embree_device        = nullptr;
-    RTCScene    m_embree_scene         = nullptr;
-    RTCGeometry m_embree_triangle_mesh = nullptr;
-
     bool m_enable_conservative_raster = true;
     bool m_bilinear_filtering         = true;
     bool m_visualize_atlas            = false;
     bool m_highlight_submeshes        = false;
     bool m_highlight_wireframe        = false;
     bool m_dilated                    = true;
+    bool m_convergence_heat_map       = false;
     bool m_bake_in_progress           = false;
 
     std::default_random_engine            m_generator;
     std::uniform_real_distribution<float> m_distribution;
 
     glm::vec3 m_light_target;
-    glm::vec3 m_light_direction;
-    glm::vec3 m_light_color;
     Skybox    m_skybox;
 
     // Material
@@ -1479,11 +1000,15 @@ private:
     float m_camera_x;
     float m_camera_y;
 
-    float                 m_sample_weight         = 0.0f;
-    std::atomic<uint32_t> m_baking_progress       = 0;
-    uint32_t              m_total_samples_to_bake = 0;
-    dw::Task*             m_bake_parent_task      = nullptr;
-    dw::ThreadPool        m_thread_pool;
+    // Baking
+    LightmapBaker m_baker;
 };
 
-DW_DECLARE_MAIN(PrecomputedGI)
\ No newline at end of file
+int main(int argc, const char* argv[])
+{
+    if (is_headless_bake(argc, argv))
+        return headless_bake(argc, argv);
+
+    PrecomputedGI app;
+    return app.run(argc, argv);
+}
\ No newline at end of file
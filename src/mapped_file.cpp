@@ -0,0 +1,112 @@
+#include "mapped_file.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool MappedFile::open(const std::string& path)
+{
+    close();
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+    if (!mapping)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+    if (!data)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    m_file    = file;
+    m_mapping = mapping;
+    m_data    = (const uint8_t*)data;
+    m_size    = size_t(size.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void* data = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // The mapping keeps its own reference to the file.
+    ::close(fd);
+
+    if (data == MAP_FAILED)
+        return false;
+
+    m_data = (const uint8_t*)data;
+    m_size = size_t(info.st_size);
+#endif
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void MappedFile::close()
+{
+    if (!m_data)
+        return;
+
+#if defined(_WIN32)
+    UnmapViewOfFile(m_data);
+    CloseHandle(m_mapping);
+    CloseHandle(m_file);
+
+    m_file    = nullptr;
+    m_mapping = nullptr;
+#else
+    munmap((void*)m_data, m_size);
+#endif
+
+    m_data = nullptr;
+    m_size = 0;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
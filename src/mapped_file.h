@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+// Read-only memory mapping of a whole file. The mapping lives until close() or destruction.
+struct MappedFile
+{
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+    bool open(const std::string& path);
+    void close();
+
+    const uint8_t* m_data = nullptr;
+    size_t         m_size = 0;
+
+#if defined(_WIN32)
+    void* m_file    = nullptr;
+    void* m_mapping = nullptr;
+#endif
+};
@@ -0,0 +1,54 @@
+#include "parallel.h"
+#include <thread_pool.hpp>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+struct ParallelTaskArgs
+{
+    uint32_t band  = 0;
+    uint32_t start = 0;
+    uint32_t end   = 0;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+uint32_t parallel_for(dw::ThreadPool& thread_pool, uint32_t count, const std::function<void(uint32_t, uint32_t, uint32_t)>& function)
+{
+    uint32_t num_tasks     = thread_pool.num_worker_threads();
+    uint32_t band_per_task = (count + num_tasks - 1) / num_tasks;
+
+    std::vector<dw::Task*> tasks(num_tasks);
+
+    std::function<void(void*)> task_function = [&function](void* data) {
+        ParallelTaskArgs* args = (ParallelTaskArgs*)data;
+        function(args->band, args->start, args->end);
+    };
+
+    for (uint32_t i = 0; i < num_tasks; i++)
+    {
+        tasks[i]           = thread_pool.allocate();
+        tasks[i]->function = task_function;
+
+        ParallelTaskArgs* args = dw::task_data<ParallelTaskArgs>(tasks[i]);
+
+        args->band  = i;
+        args->start = std::min(band_per_task * i, count);
+        args->end   = std::min(args->start + band_per_task, count);
+
+        if (i != 0)
+        {
+            thread_pool.add_as_child(tasks[0], tasks[i]);
+            thread_pool.enqueue(tasks[i]);
+        }
+    }
+
+    thread_pool.enqueue(tasks[0]);
+
+    while (!thread_pool.is_done(tasks[0]))
+        std::this_thread::yield();
+
+    return num_tasks;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
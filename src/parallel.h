@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+
+namespace dw
+{
+class ThreadPool;
+}
+
+// Splits [0, count) into one contiguous band per worker thread, runs function(band, start, end) for every band on the
+// pool and blocks until all of them have finished. Returns the number of bands. Must not be called from a pool task.
+uint32_t parallel_for(dw::ThreadPool& thread_pool, uint32_t count, const std::function<void(uint32_t, uint32_t, uint32_t)>& function);
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+
+// Stateless counter-based random numbers: every value is a pure function of the texel, sample, bounce and dimension
+// it is used for, so no generator state is shared between bake threads and a lightmap is bit-identical regardless of
+// how its bake points are scheduled.
+
+// PCG-RXS-M-XS hash, see "Hash Functions for GPU Rendering" (Jarzynski and Olano, 2020).
+inline uint32_t pcg_hash(uint32_t v)
+{
+    uint32_t state = v * 747796405u + 2891336453u;
+    uint32_t word  = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+inline uint32_t random_uint(uint32_t texel, uint32_t sample, uint32_t bounce, uint32_t dimension)
+{
+    return pcg_hash(dimension + pcg_hash(bounce + pcg_hash(sample + pcg_hash(texel))));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Uniform float in [0, 1).
+inline float random_float(uint32_t texel, uint32_t sample, uint32_t bounce, uint32_t dimension)
+{
+    return float(random_uint(texel, sample, bounce, dimension) >> 8) * (1.0f / 16777216.0f);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
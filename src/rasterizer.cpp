@@ -0,0 +1,247 @@
+#include "rasterizer.h"
+#include "parallel.h"
+#include <thread_pool.hpp>
+#include <algorithm>
+
+// GL implementations snap window coordinates to 8 sub-pixel bits before rasterizing.
+#define RASTER_SUBPIXEL_PRECISION 256.0f
+
+struct RasterEdge
+{
+    float a;
+    float b;
+    float c;
+    bool  top_left;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static RasterEdge make_edge(const glm::vec2& v0, const glm::vec2& v1)
+{
+    // E(p) = a * p.x + b * p.y + c, positive to the left of v0 -> v1.
+    RasterEdge edge;
+
+    edge.a = v0.y - v1.y;
+    edge.b = v1.x - v0.x;
+    edge.c = v0.x * v1.y - v0.y * v1.x;
+
+    // With counter-clockwise winding and Y pointing up, left edges go down and top edges go left.
+    edge.top_left = (v1.y < v0.y) || (v1.y == v0.y && v1.x < v0.x);
+
+    return edge;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static bool inside_edge(const RasterEdge& edge, float w, bool conservative)
+{
+    if (conservative)
+        return w + 0.5f * (fabsf(edge.a) + fabsf(edge.b)) >= 0.0f;
+    else
+        return w > 0.0f || (w == 0.0f && edge.top_left);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void rasterize_triangle(const LightmapVertex* v0,
+                               const LightmapVertex* v1,
+                               const LightmapVertex* v2,
+                               int                   size,
+                               glm::ivec2            target_min,
+                               glm::ivec2            target_max,
+                               int                   start_row,
+                               int                   end_row,
+                               bool                  conservative,
+                               glm::vec4*            positions,
+                               glm::vec4*            normals)
+{
+    glm::vec2 p0 = glm::floor(v0->lightmap_uv * float(size) * RASTER_SUBPIXEL_PRECISION + 0.5f) / RASTER_SUBPIXEL_PRECISION;
+    glm::vec2 p1 = glm::floor(v1->lightmap_uv * float(size) * RASTER_SUBPIXEL_PRECISION + 0.5f) / RASTER_SUBPIXEL_PRECISION;
+    glm::vec2 p2 = glm::floor(v2->lightmap_uv * float(size) * RASTER_SUBPIXEL_PRECISION + 0.5f) / RASTER_SUBPIXEL_PRECISION;
+
+    float area = (p1.x - p0.x) * (p2.y - p0.y) - (p1.y - p0.y) * (p2.x - p0.x);
+
+    // Degenerate triangles produce no fragments.
+    if (area == 0.0f)
+        return;
+
+    // Culling is disabled, so flip clockwise triangles to keep the edge functions positive on the inside.
+    if (area < 0.0f)
+    {
+        std::swap(v1, v2);
+        std::swap(p1, p2);
+        area = -area;
+    }
+
+    glm::vec2 bb_min = glm::min(p0, glm::min(p1, p2));
+    glm::vec2 bb_max = glm::max(p0, glm::max(p1, p2));
+
+    int x_start, x_end, y_start, y_end;
+
+    if (conservative)
+    {
+        // Every pixel that overlaps the triangle bounds.
+        x_start = int(floorf(bb_min.x));
+        y_start = int(floorf(bb_min.y));
+        x_end   = int(ceilf(bb_max.x)) - 1;
+        y_end   = int(ceilf(bb_max.y)) - 1;
+    }
+    else
+    {
+        // Every pixel whose center lies within the triangle bounds.
+        x_start = int(ceilf(bb_min.x - 0.5f));
+        y_start = int(ceilf(bb_min.y - 0.5f));
+        x_end   = int(floorf(bb_max.x - 0.5f));
+        y_end   = int(floorf(bb_max.y - 0.5f));
+    }
+
+    x_start = std::max(x_start, target_min.x);
+    y_start = std::max(y_start, start_row);
+    x_end   = std::min(x_end, target_max.x - 1);
+    y_end   = std::min(y_end, end_row - 1);
+
+    const int stride = target_max.x - target_min.x;
+
+    RasterEdge e0 = make_edge(p1, p2);
+    RasterEdge e1 = make_edge(p2, p0);
+    RasterEdge e2 = make_edge(p0, p1);
+
+    float inv_area = 1.0f / area;
+
+    for (int y = y_start; y <= y_end; y++)
+    {
+        float py = float(y) + 0.5f;
+
+        for (int x = x_start; x <= x_end; x++)
+        {
+            float px = float(x) + 0.5f;
+
+            float w0 = e0.a * px + e0.b * py + e0.c;
+            float w1 = e1.a * px + e1.b * py + e1.c;
+            float w2 = e2.a * px + e2.b * py + e2.c;
+
+            if (!inside_edge(e0, w0, conservative) || !inside_edge(e1, w1, conservative) || !inside_edge(e2, w2, conservative))
+                continue;
+
+            // Attributes are always evaluated at the pixel center, even when it lies outside of a conservatively rasterized triangle.
+            w0 *= inv_area;
+            w1 *= inv_area;
+            w2 *= inv_area;
+
+            glm::vec3 position = v0->position * w0 + v1->position * w1 + v2->position * w2;
+            glm::vec3 normal   = glm::normalize(v0->normal * w0 + v1->normal * w1 + v2->normal * w2);
+
+            int texel = stride * (y - target_min.y) + x - target_min.x;
+
+            positions[texel] = glm::vec4(position, 1.0f);
+            normals[texel]   = glm::vec4(normal, 1.0f);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void rasterize_bake_points(dw::ThreadPool&                    thread_pool,
+                           const std::vector<LightmapVertex>&  vertices,
+                           const std::vector<uint32_t>&        indices,
+                           const std::vector<LightmapSubMesh>& submeshes,
+                           const std::vector<uint32_t>&        vertex_pages,
+                           uint32_t                            page,
+                           int                                 size,
+                           glm::ivec2                          region_min,
+                           glm::ivec2                          region_max,
+                           bool                                conservative,
+                           BakePoints&                         bake_points)
+{
+    // The dilation below reads one texel beyond the region, so that border is rasterized as well.
+    const glm::ivec2 target_min = glm::max(region_min - 1, glm::ivec2(0));
+    const glm::ivec2 target_max = glm::min(region_max + 1, glm::ivec2(size));
+    const int        width      = target_max.x - target_min.x;
+    const int        height     = target_max.y - target_min.y;
+
+    std::vector<glm::vec4> positions(width * height, glm::vec4(0.0f));
+    std::vector<glm::vec4> normals(width * height, glm::vec4(0.0f));
+
+    // Each task owns a band of rows and walks the triangles in draw order, so overlapping triangles resolve exactly like
+    // the GL pass did (last one wins) without any synchronization.
+    parallel_for(thread_pool, height, [&](uint32_t band, uint32_t start, uint32_t end) {
+        const int start_row = target_min.y + int(start);
+        const int end_row   = target_min.y + int(end);
+
+        for (const LightmapSubMesh& submesh : submeshes)
+        {
+            for (uint32_t i = 0; i < submesh.index_count; i += 3)
+            {
+                // A chart never spans pages, so the first vertex decides for the whole triangle.
+                uint32_t vertex_page = vertex_pages.empty() ? 0 : vertex_pages[submesh.base_vertex + indices[submesh.base_index + i]];
+
+                if (vertex_page != page)
+                    continue;
+
+                const LightmapVertex* v0 = &vertices[submesh.base_vertex + indices[submesh.base_index + i]];
+                const LightmapVertex* v1 = &vertices[submesh.base_vertex + indices[submesh.base_index + i + 1]];
+                const LightmapVertex* v2 = &vertices[submesh.base_vertex + indices[submesh.base_index + i + 2]];
+
+                glm::vec2 min_uv = glm::min(v0->lightmap_uv, glm::min(v1->lightmap_uv, v2->lightmap_uv)) * float(size);
+                glm::vec2 max_uv = glm::max(v0->lightmap_uv, glm::max(v1->lightmap_uv, v2->lightmap_uv)) * float(size);
+
+                if (max_uv.y < float(start_row) - 1.0f || min_uv.y > float(end_row) + 1.0f)
+                    continue;
+
+                if (max_uv.x < float(target_min.x) - 1.0f || min_uv.x > float(target_max.x) + 1.0f)
+                    continue;
+
+                rasterize_triangle(v0, v1, v2, size, target_min, target_max, start_row, end_row, conservative, positions.data(), normals.data());
+            }
+        }
+    });
+
+    std::vector<BakePoints> band_points(thread_pool.num_worker_threads());
+
+    // Dilate by one texel using the same neighbour order as dilate_lightmap() and emit bake points in raster order.
+    parallel_for(thread_pool, region_max.y - region_min.y, [&](uint32_t band, uint32_t start, uint32_t end) {
+        for (int y = region_min.y + int(start); y < region_min.y + int(end); y++)
+        {
+            for (int x = region_min.x; x < region_max.x; x++)
+            {
+                int src = width * (y - target_min.y) + x - target_min.x;
+
+                if (normals[src].w == 0.0f)
+                {
+                    src = -1;
+
+                    for (const glm::ivec2& offset : DilateOffsets)
+                    {
+                        int nx = std::min(std::max(x + offset.x, 0), size - 1);
+                        int ny = std::min(std::max(y + offset.y, 0), size - 1);
+                        int n  = width * (ny - target_min.y) + nx - target_min.x;
+
+                        if (normals[n].w > 0.0f)
+                        {
+                            src = n;
+                            break;
+                        }
+                    }
+
+                    if (src == -1)
+                        continue;
+                }
+
+                glm::vec3 normal = normals[src];
+
+                // Check if this is a valid lightmap texel
+                if (normal.x == 0.0f && normal.y == 0.0f && normal.z == 0.0f)
+                    continue;
+
+                band_points[band].push_back(glm::vec3(positions[src]), normal, uint32_t(size * y + x));
+            }
+        }
+    });
+
+    bake_points.clear();
+
+    for (const BakePoints& points : band_points)
+        bake_points.append(points);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
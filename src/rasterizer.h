@@ -0,0 +1,27 @@
+#pragma once
+
+#include "lightmap.h"
+#include <vector>
+
+namespace dw
+{
+class ThreadPool;
+}
+
+// Rasterizes the unwrapped mesh in lightmap UV space on the CPU and emits a bake point for every texel that is either
+// covered by a triangle or within the one texel dilation border around one, in raster order of the atlas. This is
+// a drop-in replacement for the old GL position/normal G-buffer pass and follows the same coverage rules. Only
+// triangles on the given atlas page are rasterized; an empty vertex_pages puts every vertex on page zero. Only bake
+// points within [region_min, region_max) are emitted, with the working memory bounded by the region rather than
+// the atlas; the result is the same subset of the bake points of the whole atlas.
+void rasterize_bake_points(dw::ThreadPool&                    thread_pool,
+                           const std::vector<LightmapVertex>&  vertices,
+                           const std::vector<uint32_t>&        indices,
+                           const std::vector<LightmapSubMesh>& submeshes,
+                           const std::vector<uint32_t>&        vertex_pages,
+                           uint32_t                            page,
+                           int                                 size,
+                           glm::ivec2                          region_min,
+                           glm::ivec2                          region_max,
+                           bool                                conservative,
+                           BakePoints&                         bake_points);
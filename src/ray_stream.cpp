@@ -0,0 +1,184 @@
+#include "ray_stream.h"
+#include <algorithm>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static uint64_t expand_bits(uint64_t v)
+{
+    // Spread the lower 10 bits of v so that there are two zero bits between each of them.
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+
+    return v;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+uint64_t morton_code(const glm::vec3& p, const glm::vec3& bounds_min, const glm::vec3& bounds_max)
+{
+    glm::vec3 extents = glm::max(bounds_max - bounds_min, glm::vec3(1e-6f));
+    glm::vec3 n       = glm::clamp((p - bounds_min) / extents, 0.0f, 1.0f) * 1023.0f;
+
+    return (expand_bits(uint64_t(n.x)) << 2) | (expand_bits(uint64_t(n.y)) << 1) | expand_bits(uint64_t(n.z));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayStream::reserve(uint32_t size)
+{
+    m_entries.reserve(size);
+
+    m_org_x.resize(size);
+    m_org_y.resize(size);
+    m_org_z.resize(size);
+    m_tnear.resize(size);
+    m_dir_x.resize(size);
+    m_dir_y.resize(size);
+    m_dir_z.resize(size);
+    m_time.resize(size);
+    m_tfar.resize(size);
+    m_mask.resize(size);
+    m_id.resize(size);
+    m_flags.resize(size);
+
+    m_ng_x.resize(size);
+    m_ng_y.resize(size);
+    m_ng_z.resize(size);
+    m_u.resize(size);
+    m_v.resize(size);
+    m_prim_id.resize(size);
+    m_geom_id.resize(size);
+    m_inst_id.resize(size);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayStream::clear()
+{
+    m_entries.clear();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayStream::push(const glm::vec3& origin, const glm::vec3& direction, uint32_t id)
+{
+    m_entries.push_back({ 0, origin, direction, id });
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayStream::sort(const glm::vec3& bounds_min, const glm::vec3& bounds_max)
+{
+    // Group rays by direction octant first and then by origin along a Z-order curve, so that neighbouring rays in the
+    // stream tend to visit the same BVH nodes.
+    for (RayStreamEntry& entry : m_entries)
+    {
+        uint64_t octant = (entry.direction.x < 0.0f ? 1 : 0) | (entry.direction.y < 0.0f ? 2 : 0) | (entry.direction.z < 0.0f ? 4 : 0);
+        entry.key       = (octant << 30) | morton_code(entry.origin, bounds_min, bounds_max);
+    }
+
+    std::sort(m_entries.begin(), m_entries.end(), [](const RayStreamEntry& a, const RayStreamEntry& b) { return a.key < b.key; });
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayStream::prepare()
+{
+    if (m_org_x.size() < m_entries.size())
+        reserve(uint32_t(m_entries.size()));
+
+    for (uint32_t i = 0; i < m_entries.size(); i++)
+    {
+        const RayStreamEntry& entry = m_entries[i];
+
+        m_org_x[i] = entry.origin.x;
+        m_org_y[i] = entry.origin.y;
+        m_org_z[i] = entry.origin.z;
+        m_dir_x[i] = entry.direction.x;
+        m_dir_y[i] = entry.direction.y;
+        m_dir_z[i] = entry.direction.z;
+        m_tnear[i] = 0.0f;
+        m_tfar[i]  = INFINITY;
+        m_time[i]  = 0.0f;
+        m_mask[i]  = 0xFFFFFFFF;
+        m_id[i]    = entry.id;
+        m_flags[i] = 0;
+
+        m_geom_id[i] = RTC_INVALID_GEOMETRY_ID;
+        m_inst_id[i] = RTC_INVALID_GEOMETRY_ID;
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayStream::intersect(RTCScene scene)
+{
+    prepare();
+
+    if (m_entries.empty())
+        return;
+
+    RTCIntersectContext context;
+    rtcInitIntersectContext(&context);
+    context.flags = RTC_INTERSECT_CONTEXT_FLAG_COHERENT;
+
+    RTCRayHitNp rayhit;
+
+    rayhit.ray.org_x     = m_org_x.data();
+    rayhit.ray.org_y     = m_org_y.data();
+    rayhit.ray.org_z     = m_org_z.data();
+    rayhit.ray.tnear     = m_tnear.data();
+    rayhit.ray.dir_x     = m_dir_x.data();
+    rayhit.ray.dir_y     = m_dir_y.data();
+    rayhit.ray.dir_z     = m_dir_z.data();
+    rayhit.ray.time      = m_time.data();
+    rayhit.ray.tfar      = m_tfar.data();
+    rayhit.ray.mask      = m_mask.data();
+    rayhit.ray.id        = m_id.data();
+    rayhit.ray.flags     = m_flags.data();
+    rayhit.hit.Ng_x      = m_ng_x.data();
+    rayhit.hit.Ng_y      = m_ng_y.data();
+    rayhit.hit.Ng_z      = m_ng_z.data();
+    rayhit.hit.u         = m_u.data();
+    rayhit.hit.v         = m_v.data();
+    rayhit.hit.primID    = m_prim_id.data();
+    rayhit.hit.geomID    = m_geom_id.data();
+    rayhit.hit.instID[0] = m_inst_id.data();
+
+    rtcIntersectNp(scene, &context, &rayhit, uint32_t(m_entries.size()));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void RayStream::occluded(RTCScene scene)
+{
+    prepare();
+
+    if (m_entries.empty())
+        return;
+
+    RTCIntersectContext context;
+    rtcInitIntersectContext(&context);
+    context.flags = RTC_INTERSECT_CONTEXT_FLAG_COHERENT;
+
+    RTCRayNp ray;
+
+    ray.org_x = m_org_x.data();
+    ray.org_y = m_org_y.data();
+    ray.org_z = m_org_z.data();
+    ray.tnear = m_tnear.data();
+    ray.dir_x = m_dir_x.data();
+    ray.dir_y = m_dir_y.data();
+    ray.dir_z = m_dir_z.data();
+    ray.time  = m_time.data();
+    ray.tfar  = m_tfar.data();
+    ray.mask  = m_mask.data();
+    ray.id    = m_id.data();
+    ray.flags = m_flags.data();
+
+    rtcOccludedNp(scene, &context, &ray, uint32_t(m_entries.size()));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
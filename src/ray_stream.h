@@ -0,0 +1,68 @@
+#pragma once
+
+#include <ogl.h>
+#include <rtcore.h>
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+
+struct RayStreamEntry
+{
+    uint64_t  key;
+    glm::vec3 origin;
+    glm::vec3 direction;
+    uint32_t  id;
+};
+
+// 30-bit Morton code of p quantized to 10 bits per axis within the given bounds.
+uint64_t morton_code(const glm::vec3& p, const glm::vec3& bounds_min, const glm::vec3& bounds_max);
+
+// A batch of rays in the structure-of-arrays layout expected by Embree's stream API. Rays are gathered with push(),
+// optionally reordered for coherence with sort() and then traced in a single rtcIntersectNp/rtcOccludedNp call.
+struct RayStream
+{
+    void      reserve(uint32_t size);
+    void      clear();
+    void      push(const glm::vec3& origin, const glm::vec3& direction, uint32_t id);
+    void      sort(const glm::vec3& bounds_min, const glm::vec3& bounds_max);
+    void      intersect(RTCScene scene);
+    void      occluded(RTCScene scene);
+    uint32_t  size() const { return uint32_t(m_entries.size()); }
+    uint32_t  id(uint32_t i) const { return m_id[i]; }
+    glm::vec3 origin(uint32_t i) const { return glm::vec3(m_org_x[i], m_org_y[i], m_org_z[i]); }
+    glm::vec3 direction(uint32_t i) const { return glm::vec3(m_dir_x[i], m_dir_y[i], m_dir_z[i]); }
+    float     tfar(uint32_t i) const { return m_tfar[i]; }
+    bool      is_hit(uint32_t i) const { return m_geom_id[i] != RTC_INVALID_GEOMETRY_ID; }
+    uint32_t  prim_id(uint32_t i) const { return m_prim_id[i]; }
+    uint32_t  geom_id(uint32_t i) const { return m_geom_id[i]; }
+    uint32_t  inst_id(uint32_t i) const { return m_inst_id[i]; }
+    glm::vec3 normal(uint32_t i) const { return glm::vec3(m_ng_x[i], m_ng_y[i], m_ng_z[i]); }
+    bool      is_occluded(uint32_t i) const { return m_tfar[i] == -INFINITY; }
+    void      prepare();
+
+    std::vector<RayStreamEntry> m_entries;
+
+    // Ray
+    std::vector<float>    m_org_x;
+    std::vector<float>    m_org_y;
+    std::vector<float>    m_org_z;
+    std::vector<float>    m_tnear;
+    std::vector<float>    m_dir_x;
+    std::vector<float>    m_dir_y;
+    std::vector<float>    m_dir_z;
+    std::vector<float>    m_time;
+    std::vector<float>    m_tfar;
+    std::vector<uint32_t> m_mask;
+    std::vector<uint32_t> m_id;
+    std::vector<uint32_t> m_flags;
+
+    // Hit
+    std::vector<float>    m_ng_x;
+    std::vector<float>    m_ng_y;
+    std::vector<float>    m_ng_z;
+    std::vector<float>    m_u;
+    std::vector<float>    m_v;
+    std::vector<uint32_t> m_prim_id;
+    std::vector<uint32_t> m_geom_id;
+    std::vector<uint32_t> m_inst_id;
+};
@@ -0,0 +1,566 @@
+#include "scene.h"
+#include "hash.h"
+#include "mapped_file.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+struct ObjIndex
+{
+    int position  = -1;
+    int tex_coord = -1;
+    int normal    = -1;
+
+    bool operator==(const ObjIndex& other) const
+    {
+        return position == other.position && tex_coord == other.tex_coord && normal == other.normal;
+    }
+};
+
+struct ObjIndexHash
+{
+    size_t operator()(const ObjIndex& idx) const
+    {
+        return (size_t(uint32_t(idx.position)) * 73856093) ^ (size_t(uint32_t(idx.tex_coord)) * 19349663) ^ (size_t(uint32_t(idx.normal)) * 83492791);
+    }
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static int resolve_obj_index(const std::string& token, size_t count)
+{
+    if (token.empty())
+        return -1;
+
+    int idx = std::stoi(token);
+
+    // OBJ indices are one based, negative indices are relative to the end of the list.
+    return idx < 0 ? int(count) + idx : idx - 1;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static ObjIndex parse_obj_index(const std::string& token, size_t num_positions, size_t num_tex_coords, size_t num_normals)
+{
+    ObjIndex idx;
+
+    size_t first  = token.find('/');
+    size_t second = first == std::string::npos ? std::string::npos : token.find('/', first + 1);
+
+    idx.position = resolve_obj_index(token.substr(0, first), num_positions);
+
+    if (first != std::string::npos)
+        idx.tex_coord = resolve_obj_index(token.substr(first + 1, second == std::string::npos ? std::string::npos : second - first - 1), num_tex_coords);
+
+    if (second != std::string::npos)
+        idx.normal = resolve_obj_index(token.substr(second + 1), num_normals);
+
+    return idx;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void load_mtl(const std::string& path, std::unordered_map<std::string, glm::vec3>& materials)
+{
+    std::ifstream file(path);
+
+    if (!file.is_open())
+        return;
+
+    std::string line;
+    std::string current;
+
+    while (std::getline(file, line))
+    {
+        std::istringstream stream(line);
+        std::string        keyword;
+
+        stream >> keyword;
+
+        if (keyword == "newmtl")
+        {
+            stream >> current;
+            materials[current] = glm::vec3(1.0f);
+        }
+        else if (keyword == "Kd" && !current.empty())
+        {
+            glm::vec3 albedo;
+            stream >> albedo.x >> albedo.y >> albedo.z;
+            materials[current] = albedo;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Stat-based rather than a hash of the contents, so checking a scene file does not read its sources. Missing files
+// are part of the key too, a material library that appears later changes it.
+static uint64_t source_key(const std::vector<std::string>& paths)
+{
+    uint64_t key = HASH_SEED;
+
+    for (const std::string& path : paths)
+    {
+        struct stat info;
+        int64_t     size  = -1;
+        int64_t     mtime = -1;
+
+        if (stat(path.c_str(), &info) == 0)
+        {
+            size  = int64_t(info.st_size);
+            mtime = int64_t(info.st_mtime);
+        }
+
+        key = hash_bytes(path.data(), path.size(), key);
+        key = hash_value(size, key);
+        key = hash_value(mtime, key);
+    }
+
+    return key;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool Scene::load(const std::string& path)
+{
+    size_t dot = path.find_last_of('.');
+
+    if (dot != std::string::npos && path.substr(dot) == SCENE_FILE_EXTENSION)
+        return load_binary(path);
+    else
+        return load_obj(path);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool Scene::load_obj(const std::string& path)
+{
+    std::ifstream file(path);
+
+    if (!file.is_open())
+        return false;
+
+    m_mapping.reset();
+    m_vertex_storage.clear();
+    m_index_storage.clear();
+    m_submesh_storage.clear();
+
+    m_sources.assign(1, path);
+
+    std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+
+    std::vector<glm::vec3>                               positions;
+    std::vector<glm::vec3>                               normals;
+    std::vector<glm::vec2>                               tex_coords;
+    std::vector<bool>                                    generated_normals;
+    std::unordered_map<std::string, glm::vec3>           materials;
+    std::unordered_map<ObjIndex, uint32_t, ObjIndexHash> vertex_map;
+
+    glm::vec3 albedo = glm::vec3(1.0f);
+
+    // Start a new submesh whenever the group or material changes, like the assimp OBJ importer does.
+    auto begin_submesh = [&]() {
+        if (!m_submesh_storage.empty() && m_submesh_storage.back().index_count == 0)
+            m_submesh_storage.pop_back();
+
+        SceneSubMesh submesh;
+
+        submesh.index_count = 0;
+        submesh.base_vertex = uint32_t(m_vertex_storage.size());
+        submesh.base_index  = uint32_t(m_index_storage.size());
+        submesh.max_extents = glm::vec3(-INFINITY);
+        submesh.min_extents = glm::vec3(INFINITY);
+        submesh.albedo      = albedo;
+
+        m_submesh_storage.push_back(submesh);
+        vertex_map.clear();
+    };
+
+    auto add_vertex = [&](const ObjIndex& idx, const glm::vec3& face_normal) -> uint32_t {
+        SceneSubMesh& submesh = m_submesh_storage.back();
+        auto          it      = vertex_map.find(idx);
+
+        if (it != vertex_map.end())
+        {
+            // Vertices without an explicit normal get an area weighted average of the faces that share them.
+            if (idx.normal == -1)
+                m_vertex_storage[submesh.base_vertex + it->second].normal += face_normal;
+
+            return it->second;
+        }
+
+        SceneVertex v;
+
+        v.position  = positions[idx.position];
+        v.tex_coord = idx.tex_coord != -1 ? tex_coords[idx.tex_coord] : glm::vec2(0.0f);
+        v.normal    = idx.normal != -1 ? normals[idx.normal] : face_normal;
+        v.tangent   = glm::vec3(0.0f);
+        v.bitangent = glm::vec3(0.0f);
+
+        submesh.max_extents = glm::max(submesh.max_extents, v.position);
+        submesh.min_extents = glm::min(submesh.min_extents, v.position);
+
+        uint32_t local_idx = uint32_t(m_vertex_storage.size()) - submesh.base_vertex;
+
+        m_vertex_storage.push_back(v);
+        generated_normals.push_back(idx.normal == -1);
+        vertex_map[idx] = local_idx;
+
+        return local_idx;
+    };
+
+    begin_submesh();
+
+    std::string              line;
+    std::vector<std::string> tokens;
+
+    while (std::getline(file, line))
+    {
+        std::istringstream stream(line);
+        std::string        keyword;
+
+        stream >> keyword;
+
+        if (keyword == "v")
+        {
+            glm::vec3 p;
+            stream >> p.x >> p.y >> p.z;
+            positions.push_back(p);
+        }
+        else if (keyword == "vn")
+        {
+            glm::vec3 n;
+            stream >> n.x >> n.y >> n.z;
+            normals.push_back(n);
+        }
+        else if (keyword == "vt")
+        {
+            glm::vec2 uv;
+            stream >> uv.x >> uv.y;
+            tex_coords.push_back(uv);
+        }
+        else if (keyword == "f")
+        {
+            tokens.clear();
+
+            std::string token;
+
+            while (stream >> token)
+                tokens.push_back(token);
+
+            if (tokens.size() < 3)
+                continue;
+
+            ObjIndex i0 = parse_obj_index(tokens[0], positions.size(), tex_coords.size(), normals.size());
+
+            // Triangulate polygons as a fan around the first corner.
+            for (size_t i = 2; i < tokens.size(); i++)
+            {
+                ObjIndex i1 = parse_obj_index(tokens[i - 1], positions.size(), tex_coords.size(), normals.size());
+                ObjIndex i2 = parse_obj_index(tokens[i], positions.size(), tex_coords.size(), normals.size());
+
+                if (i0.position < 0 || i1.position < 0 || i2.position < 0 || i0.position >= int(positions.size()) || i1.position >= int(positions.size()) || i2.position >= int(positions.size()))
+                    return false;
+
+                glm::vec3 face_normal = glm::cross(positions[i1.position] - positions[i0.position], positions[i2.position] - positions[i0.position]);
+
+                m_index_storage.push_back(add_vertex(i0, face_normal));
+                m_index_storage.push_back(add_vertex(i1, face_normal));
+                m_index_storage.push_back(add_vertex(i2, face_normal));
+
+                m_submesh_storage.back().index_count += 3;
+            }
+        }
+        else if (keyword == "usemtl")
+        {
+            std::string name;
+            stream >> name;
+
+            auto it = materials.find(name);
+            albedo  = it != materials.end() ? it->second : glm::vec3(1.0f);
+
+            begin_submesh();
+        }
+        else if (keyword == "o" || keyword == "g")
+            begin_submesh();
+        else if (keyword == "mtllib")
+        {
+            std::string name;
+            stream >> name;
+            load_mtl(directory + name, materials);
+
+            m_sources.push_back(directory + name);
+        }
+    }
+
+    if (m_submesh_storage.back().index_count == 0)
+        m_submesh_storage.pop_back();
+
+    // Accumulate per-vertex tangent frames from the texture coordinates.
+    for (const SceneSubMesh& submesh : m_submesh_storage)
+    {
+        for (uint32_t i = 0; i < submesh.index_count; i += 3)
+        {
+            SceneVertex& v0 = m_vertex_storage[submesh.base_vertex + m_index_storage[submesh.base_index + i]];
+            SceneVertex& v1 = m_vertex_storage[submesh.base_vertex + m_index_storage[submesh.base_index + i + 1]];
+            SceneVertex& v2 = m_vertex_storage[submesh.base_vertex + m_index_storage[submesh.base_index + i + 2]];
+
+            glm::vec3 e1   = v1.position - v0.position;
+            glm::vec3 e2   = v2.position - v0.position;
+            glm::vec2 duv1 = v1.tex_coord - v0.tex_coord;
+            glm::vec2 duv2 = v2.tex_coord - v0.tex_coord;
+
+            float det = duv1.x * duv2.y - duv2.x * duv1.y;
+
+            if (det == 0.0f)
+                continue;
+
+            float     r = 1.0f / det;
+            glm::vec3 t = (e1 * duv2.y - e2 * duv1.y) * r;
+            glm::vec3 b = (e2 * duv1.x - e1 * duv2.x) * r;
+
+            v0.tangent += t;
+            v1.tangent += t;
+            v2.tangent += t;
+
+            v0.bitangent += b;
+            v1.bitangent += b;
+            v2.bitangent += b;
+        }
+    }
+
+    for (size_t i = 0; i < m_vertex_storage.size(); i++)
+    {
+        SceneVertex& v = m_vertex_storage[i];
+
+        if (generated_normals[i] && glm::length(v.normal) > 0.0f)
+            v.normal = glm::normalize(v.normal);
+
+        // Gram-Schmidt orthogonalize against the normal.
+        glm::vec3 t = v.tangent - v.normal * glm::dot(v.normal, v.tangent);
+
+        if (glm::length(t) > 0.0f)
+        {
+            v.tangent   = glm::normalize(t);
+            v.bitangent = glm::normalize(glm::cross(v.normal, v.tangent)) * (glm::dot(glm::cross(v.normal, v.tangent), v.bitangent) < 0.0f ? -1.0f : 1.0f);
+        }
+    }
+
+    m_vertices  = ArrayView<SceneVertex>(m_vertex_storage.data(), m_vertex_storage.size());
+    m_indices   = ArrayView<uint32_t>(m_index_storage.data(), m_index_storage.size());
+    m_submeshes = ArrayView<SceneSubMesh>(m_submesh_storage.data(), m_submesh_storage.size());
+
+    m_source_key = source_key(m_sources);
+
+    return !m_submeshes.empty();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool Scene::load_binary(const std::string& path)
+{
+    std::shared_ptr<MappedFile> mapping = std::make_shared<MappedFile>();
+
+    if (!mapping->open(path) || mapping->m_size < sizeof(SceneFileHeader))
+        return false;
+
+    const SceneFileHeader* header = (const SceneFileHeader*)mapping->m_data;
+
+    if (header->magic != SCENE_FILE_MAGIC || header->version != SCENE_FILE_VERSION)
+        return false;
+
+    // Written so that a hostile offset cannot overflow.
+    auto is_valid_range = [&](uint64_t offset, uint64_t size) {
+        return offset % SCENE_FILE_ALIGNMENT == 0 && size <= mapping->m_size && offset <= mapping->m_size - size;
+    };
+
+    if (!is_valid_range(header->vertex_offset, uint64_t(header->vertex_count) * sizeof(SceneVertex)) ||
+        !is_valid_range(header->index_offset, uint64_t(header->index_count) * sizeof(uint32_t)) ||
+        !is_valid_range(header->submesh_offset, uint64_t(header->submesh_count) * sizeof(SceneSubMesh)) ||
+        !is_valid_range(header->source_offset, header->source_size))
+        return false;
+
+    const char* sources = (const char*)(mapping->m_data + header->source_offset);
+
+    if (header->source_size > 0 && sources[header->source_size - 1] != '\0')
+        return false;
+
+    const SceneVertex*  vertices  = (const SceneVertex*)(mapping->m_data + header->vertex_offset);
+    const uint32_t*     indices   = (const uint32_t*)(mapping->m_data + header->index_offset);
+    const SceneSubMesh* submeshes = (const SceneSubMesh*)(mapping->m_data + header->submesh_offset);
+
+    // The arrays go straight to Embree and the unwrap, so a truncated or edited file must fail here rather than be
+    // read out of bounds later.
+    for (uint32_t i = 0; i < header->submesh_count; i++)
+    {
+        const SceneSubMesh& submesh = submeshes[i];
+
+        if (uint64_t(submesh.base_index) + submesh.index_count > header->index_count)
+            return false;
+
+        for (uint32_t k = 0; k < submesh.index_count; k++)
+        {
+            if (uint64_t(submesh.base_vertex) + indices[submesh.base_index + k] >= header->vertex_count)
+                return false;
+        }
+    }
+
+    m_vertex_storage.clear();
+    m_index_storage.clear();
+    m_submesh_storage.clear();
+
+    m_vertices  = ArrayView<SceneVertex>(vertices, header->vertex_count);
+    m_indices   = ArrayView<uint32_t>(indices, header->index_count);
+    m_submeshes = ArrayView<SceneSubMesh>(submeshes, header->submesh_count);
+    m_mapping   = mapping;
+
+    m_sources.clear();
+
+    for (uint32_t i = 0; i < header->source_size; i += uint32_t(m_sources.back().size()) + 1)
+        m_sources.push_back(sources + i);
+
+    m_source_key = header->source_key;
+
+    return !m_submeshes.empty();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool Scene::write_binary(const std::string& path) const
+{
+    auto align = [](uint64_t offset) {
+        return (offset + SCENE_FILE_ALIGNMENT - 1) / SCENE_FILE_ALIGNMENT * SCENE_FILE_ALIGNMENT;
+    };
+
+    SceneFileHeader header;
+
+    memset(&header, 0, sizeof(header));
+
+    header.magic          = SCENE_FILE_MAGIC;
+    header.version        = SCENE_FILE_VERSION;
+    header.vertex_count   = uint32_t(m_vertices.size());
+    header.index_count    = uint32_t(m_indices.size());
+    header.submesh_count  = uint32_t(m_submeshes.size());
+    header.vertex_offset  = align(sizeof(SceneFileHeader));
+    header.index_offset   = align(header.vertex_offset + m_vertices.size() * sizeof(SceneVertex));
+    header.submesh_offset = align(header.index_offset + m_indices.size() * sizeof(uint32_t));
+    header.source_offset  = align(header.submesh_offset + m_submeshes.size() * sizeof(SceneSubMesh));
+    header.source_key     = m_source_key;
+
+    std::string sources;
+
+    for (const std::string& source : m_sources)
+        sources.append(source.c_str(), source.size() + 1);
+
+    header.source_size = uint32_t(sources.size());
+
+    FILE* f = fopen(path.c_str(), "wb");
+
+    if (!f)
+        return false;
+
+    const uint8_t padding[SCENE_FILE_ALIGNMENT] = {};
+    uint64_t      offset                        = 0;
+
+    auto write = [&](uint64_t section_offset, const void* data, size_t size) {
+        bool success = fwrite(padding, 1, size_t(section_offset - offset), f) == size_t(section_offset - offset) && fwrite(data, 1, size, f) == size;
+        offset       = section_offset + size;
+        return success;
+    };
+
+    bool success = write(0, &header, sizeof(header));
+
+    success = success && write(header.vertex_offset, m_vertices.data(), m_vertices.size() * sizeof(SceneVertex));
+    success = success && write(header.index_offset, m_indices.data(), m_indices.size() * sizeof(uint32_t));
+    success = success && write(header.submesh_offset, m_submeshes.data(), m_submeshes.size() * sizeof(SceneSubMesh));
+    success = success && write(header.source_offset, sources.data(), sources.size());
+
+    return fclose(f) == 0 && success;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// True if a source file changed since the scene was parsed. Always false for a freshly parsed OBJ, unless it was
+// edited while loading.
+bool Scene::is_stale() const
+{
+    return source_key(m_sources) != m_source_key;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool InstancedScene::load(const std::string& path)
+{
+    m_meshes.clear();
+    m_instances.clear();
+    m_mesh_storage.clear();
+
+    size_t dot = path.find_last_of('.');
+
+    if (dot == std::string::npos || path.substr(dot) != SCENE_DESCRIPTION_EXTENSION)
+    {
+        m_mesh_storage.push_back(std::unique_ptr<Scene>(new Scene()));
+
+        if (!m_mesh_storage.back()->load(path))
+            return false;
+
+        m_meshes.push_back(m_mesh_storage.back().get());
+        m_instances.push_back({ 0, glm::mat4(1.0f) });
+
+        return true;
+    }
+
+    std::ifstream file(path);
+
+    if (!file.is_open())
+        return false;
+
+    std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+    std::string line;
+
+    while (std::getline(file, line))
+    {
+        std::istringstream stream(line);
+        std::string        keyword;
+
+        stream >> keyword;
+
+        if (keyword == "mesh")
+        {
+            std::string name;
+            stream >> name;
+
+            m_mesh_storage.push_back(std::unique_ptr<Scene>(new Scene()));
+
+            if (name.empty() || !m_mesh_storage.back()->load(directory + name))
+                return false;
+
+            m_meshes.push_back(m_mesh_storage.back().get());
+        }
+        else if (keyword == "instance")
+        {
+            uint32_t  mesh;
+            glm::vec3 t, r, s;
+
+            if (!(stream >> mesh >> t.x >> t.y >> t.z >> r.x >> r.y >> r.z >> s.x >> s.y >> s.z) || mesh >= m_meshes.size())
+                return false;
+
+            glm::mat4 transform = glm::translate(glm::mat4(1.0f), t);
+
+            transform = glm::rotate(transform, glm::radians(r.z), glm::vec3(0.0f, 0.0f, 1.0f));
+            transform = glm::rotate(transform, glm::radians(r.y), glm::vec3(0.0f, 1.0f, 0.0f));
+            transform = glm::rotate(transform, glm::radians(r.x), glm::vec3(1.0f, 0.0f, 0.0f));
+            transform = glm::scale(transform, s);
+
+            m_instances.push_back({ mesh, transform });
+        }
+    }
+
+    return !m_instances.empty();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
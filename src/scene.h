@@ -0,0 +1,129 @@
+#pragma once
+
+#include <ogl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define SCENE_FILE_MAGIC 0x4e43534c // "LSCN"
+#define SCENE_FILE_VERSION 2
+#define SCENE_FILE_ALIGNMENT 64
+#define SCENE_FILE_EXTENSION ".lmscene"
+#define SCENE_DESCRIPTION_EXTENSION ".lmdesc"
+
+struct MappedFile;
+
+struct SceneVertex
+{
+    glm::vec3 position;
+    glm::vec2 tex_coord;
+    glm::vec3 normal;
+    glm::vec3 tangent;
+    glm::vec3 bitangent;
+};
+
+struct SceneSubMesh
+{
+    uint32_t  index_count;
+    uint32_t  base_vertex;
+    uint32_t  base_index;
+    glm::vec3 max_extents;
+    glm::vec3 min_extents;
+    glm::vec3 albedo;
+};
+
+// Read-only view of an array owned by someone else.
+template <typename T>
+struct ArrayView
+{
+    ArrayView() = default;
+    ArrayView(const T* data, size_t size) :
+        m_data(data), m_size(size) {}
+
+    const T* data() const { return m_data; }
+    size_t   size() const { return m_size; }
+    bool     empty() const { return m_size == 0; }
+    const T* begin() const { return m_data; }
+    const T* end() const { return m_data + m_size; }
+    const T& operator[](size_t i) const { return m_data[i]; }
+
+    const T* m_data = nullptr;
+    size_t   m_size = 0;
+};
+
+// Preprocessed scene file: the header followed by the SceneVertex, index and SceneSubMesh arrays exactly as they are
+// laid out in memory and by the paths of the files the scene was converted from, each starting at a multiple of
+// SCENE_FILE_ALIGNMENT bytes. Loading it is a single mapping, and the vertex and index arrays are directly usable as
+// shared Embree buffers.
+struct SceneFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertex_count;
+    uint32_t index_count;
+    uint32_t submesh_count;
+    uint32_t source_size; // Bytes of the source paths, each terminated by a NUL
+    uint32_t reserved[2];
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+    uint64_t submesh_offset;
+    uint64_t source_offset;
+    uint64_t source_key; // Scene::m_source_key
+};
+
+// CPU-only triangle mesh split into per-material submeshes. Indices are relative to the base vertex of their submesh,
+// the same layout dw::Mesh uses, but loading never touches the GPU so it can be used without a GL context.
+struct Scene
+{
+    Scene() = default;
+    Scene(const Scene&) = delete;
+    Scene& operator=(const Scene&) = delete;
+    bool load(const std::string& path); // Binary if the path ends with SCENE_FILE_EXTENSION, OBJ otherwise
+    bool load_obj(const std::string& path);
+    bool load_binary(const std::string& path);
+    bool write_binary(const std::string& path) const;
+    bool is_stale() const;
+
+    ArrayView<SceneVertex>  m_vertices;
+    ArrayView<uint32_t>     m_indices;
+    ArrayView<SceneSubMesh> m_submeshes;
+
+    // Backing memory of the views: either the parsed OBJ or the mapped scene file, which is shared so that it can
+    // outlive the scene for as long as Embree reads from it.
+    std::vector<SceneVertex>    m_vertex_storage;
+    std::vector<uint32_t>       m_index_storage;
+    std::vector<SceneSubMesh>   m_submesh_storage;
+    std::shared_ptr<MappedFile> m_mapping;
+
+    // OBJ and material libraries the scene was parsed from, keyed by their paths, sizes and modification times as of
+    // parsing. A scene file carries both along, so is_stale() can tell when the file no longer matches its sources.
+    std::vector<std::string> m_sources;
+    uint64_t                 m_source_key = 0;
+};
+
+struct SceneInstance
+{
+    uint32_t  mesh;
+    glm::mat4 transform;
+};
+
+// Meshes placed any number of times through instance transforms. Each instance gets its own region of the lightmap,
+// while the ray tracing structure of a mesh is shared by all of its instances.
+//
+// A scene description is a text file with one mesh or instance per line, mesh paths relative to the file and meshes
+// numbered in the order they are declared:
+//
+//   mesh <scene.obj|scene.lmscene>
+//   instance <mesh> <tx> <ty> <tz> <rx> <ry> <rz> <sx> <sy> <sz>
+//
+// The rotation is in degrees, applied around X, then Y, then Z.
+struct InstancedScene
+{
+    bool load(const std::string& path); // Description if the path ends with SCENE_DESCRIPTION_EXTENSION, else a single mesh
+
+    std::vector<const Scene*>           m_meshes;
+    std::vector<SceneInstance>          m_instances;
+    std::vector<std::unique_ptr<Scene>> m_mesh_storage; // Backing memory of m_meshes when loaded from a file
+};
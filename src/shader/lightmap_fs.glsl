@@ -1,25 +0,0 @@
-// ------------------------------------------------------------------
-// INPUT VARIABLES  -------------------------------------------------
-// ------------------------------------------------------------------
-
-in vec3 FS_IN_Position;
-in vec3 FS_IN_Normal;
-
-// ------------------------------------------------------------------
-// OUTPUT VARIABLES  ------------------------------------------------
-// ------------------------------------------------------------------
-
-layout(location = 0) out vec4 FS_OUT_Position;
-layout(location = 1) out vec4 FS_OUT_Normal;
-
-// ------------------------------------------------------------------
-// MAIN  ------------------------------------------------------------
-// ------------------------------------------------------------------
-
-void main(void)
-{
-    FS_OUT_Position = vec4(FS_IN_Position, 1.0);
-    FS_OUT_Normal   = vec4(normalize(FS_IN_Normal), 1.0);
-}
-
-// ------------------------------------------------------------------
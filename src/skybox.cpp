@@ -1,11 +1,16 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include "skybox.h"
+#include "parallel.h"
 #include <ArHosekSkyModel.h>
 #include <logger.h>
 #include <macros.h>
+#include <algorithm>
 
 #define SKYBOX_TEXTURE_SIZE 1024
+#define SKY_TABLE_WIDTH 512
+#define SKY_TABLE_HEIGHT 128
+#define SKY_SIMD_WIDTH 8
 #define FP16_SCALE 0.0009765625f;
 static const float Pi   = 3.141592654f;
 static const float Pi2  = 6.283185307f;
@@ -57,6 +62,44 @@ static glm::vec3 map_xys_to_direction(uint64_t x, uint64_t y, uint64_t s, uint64
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
+static glm::vec3 map_theta_phi_to_direction(float theta, float phi)
+{
+    return glm::vec3(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// ArHosekSkyModel_GetRadianceInternal() in single precision for SKY_SIMD_WIDTH directions at once, written as
+// straight-line loops over independent lanes so the compiler can vectorize them. cos(theta) is passed directly, which
+// saves the acos of the double precision path, and pow(x, 1.5) is replaced by x * sqrt(x).
+static void hosek_radiance_simd(const SkyModelChannel& channel, const float* cos_theta, const float* gamma, const float* cos_gamma, float* radiance)
+{
+    const float* c = channel.config;
+
+    for (int i = 0; i < SKY_SIMD_WIDTH; i++)
+    {
+        float exp_m    = expf(c[4] * gamma[i]);
+        float ray_m    = cos_gamma[i] * cos_gamma[i];
+        float mie_base = 1.0f + c[8] * c[8] - 2.0f * c[8] * cos_gamma[i];
+        float mie_m    = (1.0f + ray_m) / (mie_base * sqrtf(mie_base));
+        float zenith   = sqrtf(cos_theta[i]);
+
+        radiance[i] = (1.0f + c[0] * expf(c[1] / (cos_theta[i] + 0.01f))) * (c[2] + c[3] * exp_m + c[5] * ray_m + c[6] * mie_m + c[7] * zenith) * channel.radiance;
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void copy_channel(const ArHosekSkyModelState* state, int channel, SkyModelChannel& dst)
+{
+    for (int i = 0; i < 9; i++)
+        dst.config[i] = float(state->configs[channel][i]);
+
+    dst.radiance = float(state->radiances[channel]);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
 Skybox::~Skybox()
 {
     DW_SAFE_DELETE(m_state_r);
@@ -66,20 +109,23 @@ Skybox::~Skybox()
 
 // -----------------------------------------------------------------------------------------------------------------------------------
 
-bool Skybox::initialize(glm::vec3 sun_dir, glm::vec3 ground_albedo, float turbidity)
+bool Skybox::initialize(glm::vec3 sun_dir, glm::vec3 ground_albedo, float turbidity, bool create_gpu_resources, dw::ThreadPool* thread_pool)
 {
     m_ground_albedo = ground_albedo;
     m_turbidity     = turbidity;
+    m_thread_pool   = thread_pool;
+
+    // Baking only needs the sky table, so headless bakes skip the cubemap and shaders entirely.
+    if (!create_gpu_resources)
+    {
+        set_sun_dir(sun_dir);
+        return true;
+    }
 
     m_skybox_texture = std::make_unique<dw::TextureCube>(SKYBOX_TEXTURE_SIZE, SKYBOX_TEXTURE_SIZE, 1, 1, GL_RGBA32F, GL_RGBA, GL_FLOAT);
     m_skybox_texture->set_mag_filter(GL_NEAREST);
     m_skybox_texture->set_min_filter(GL_NEAREST);
 
-    m_skybox_data.resize(6);
-
-    for (int i = 0; i < 6; i++)
-        m_skybox_data[i].resize(SKYBOX_TEXTURE_SIZE * SKYBOX_TEXTURE_SIZE);
-
     set_sun_dir(sun_dir);
 
     m_skybox_vs = std::unique_ptr<dw::Shader>(dw::Shader::create_from_file(GL_VERTEX_SHADER, "shader/skybox_vs.glsl"));
@@ -123,20 +169,40 @@ void Skybox::set_sun_dir(glm::vec3 sun_dir)
     m_state_g = arhosek_rgb_skymodelstate_alloc_init(m_turbidity, m_ground_albedo.y, m_elevation);
     m_state_b = arhosek_rgb_skymodelstate_alloc_init(m_turbidity, m_ground_albedo.z, m_elevation);
 
+    copy_channel(m_state_r, 0, m_channels[0]);
+    copy_channel(m_state_g, 1, m_channels[1]);
+    copy_channel(m_state_b, 2, m_channels[2]);
+
+    build_sky_table();
+
+    if (!m_skybox_texture)
+        return;
+
+    // The faces are only needed until they have been uploaded, so stage them one at a time.
+    std::vector<glm::vec4> face_data(SKYBOX_TEXTURE_SIZE * SKYBOX_TEXTURE_SIZE);
+
     for (int s = 0; s < 6; s++)
     {
-        for (int y = 0; y < SKYBOX_TEXTURE_SIZE; y++)
-        {
-            for (int x = 0; x < SKYBOX_TEXTURE_SIZE; x++)
+        parallel_rows(SKYBOX_TEXTURE_SIZE, [&](uint32_t band, uint32_t start_row, uint32_t end_row) {
+            glm::vec3 dirs[SKY_SIMD_WIDTH];
+            glm::vec3 radiance[SKY_SIMD_WIDTH];
+
+            for (uint32_t y = start_row; y < end_row; y++)
             {
-                glm::vec3 dir         = map_xys_to_direction(x, y, s, SKYBOX_TEXTURE_SIZE, SKYBOX_TEXTURE_SIZE);
-                glm::vec3 radiance    = sample_sky(dir);
-                uint64_t  idx         = (y * SKYBOX_TEXTURE_SIZE) + x;
-                m_skybox_data[s][idx] = (glm::vec4(radiance, 1.0f));
+                for (int x = 0; x < SKYBOX_TEXTURE_SIZE; x += SKY_SIMD_WIDTH)
+                {
+                    for (int i = 0; i < SKY_SIMD_WIDTH; i++)
+                        dirs[i] = map_xys_to_direction(x + i, y, s, SKYBOX_TEXTURE_SIZE, SKYBOX_TEXTURE_SIZE);
+
+                    sample_sky_simd(dirs, radiance);
+
+                    for (int i = 0; i < SKY_SIMD_WIDTH; i++)
+                        face_data[(y * SKYBOX_TEXTURE_SIZE) + x + i] = glm::vec4(radiance[i], 1.0f);
+                }
             }
-        }
+        });
 
-        m_skybox_texture->set_data(s, 0, 0, m_skybox_data[s].data());
+        m_skybox_texture->set_data(s, 0, 0, face_data.data());
     }
 }
 
@@ -193,4 +259,190 @@ glm::vec3 Skybox::sample_sky(glm::vec3 dir)
     return radiance;
 }
 
-// -----------------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Single precision equivalent of sample_sky() for SKY_SIMD_WIDTH directions.
+void Skybox::sample_sky_simd(const glm::vec3* dirs, glm::vec3* radiance)
+{
+    float cos_theta[SKY_SIMD_WIDTH];
+    float cos_gamma[SKY_SIMD_WIDTH];
+    float gamma[SKY_SIMD_WIDTH];
+
+    for (int i = 0; i < SKY_SIMD_WIDTH; i++)
+    {
+        cos_theta[i] = glm::max(dirs[i].y, 0.00001f);
+        cos_gamma[i] = glm::max(glm::dot(dirs[i], m_sun_dir), 0.00001f);
+        gamma[i]     = acosf(cos_gamma[i]);
+    }
+
+    float r[SKY_SIMD_WIDTH];
+    float g[SKY_SIMD_WIDTH];
+    float b[SKY_SIMD_WIDTH];
+
+    hosek_radiance_simd(m_channels[0], cos_theta, gamma, cos_gamma, r);
+    hosek_radiance_simd(m_channels[1], cos_theta, gamma, cos_gamma, g);
+    hosek_radiance_simd(m_channels[2], cos_theta, gamma, cos_gamma, b);
+
+    // Same luminous efficacy scale as sample_sky().
+    for (int i = 0; i < SKY_SIMD_WIDTH; i++)
+        radiance[i] = glm::vec3(r[i], g[i], b[i]) * 683.0f;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void Skybox::parallel_rows(uint32_t count, const std::function<void(uint32_t, uint32_t, uint32_t)>& function)
+{
+    if (m_thread_pool)
+        parallel_for(*m_thread_pool, count, function);
+    else
+        function(0, 0, count);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Tabulates the radiance of the upper hemisphere on a latitude-longitude grid, plus a piecewise-constant distribution
+// proportional to its luminance for importance sampling.
+void Skybox::build_sky_table()
+{
+    m_sky_radiance.resize(SKY_TABLE_WIDTH * SKY_TABLE_HEIGHT);
+    m_sky_distribution.resize(SKY_TABLE_WIDTH * SKY_TABLE_HEIGHT);
+    m_sky_conditional_cdf.resize((SKY_TABLE_WIDTH + 1) * SKY_TABLE_HEIGHT);
+    m_sky_marginal_cdf.resize(SKY_TABLE_HEIGHT + 1);
+
+    parallel_rows(SKY_TABLE_HEIGHT, [&](uint32_t band, uint32_t start_row, uint32_t end_row) {
+        glm::vec3 dirs[SKY_SIMD_WIDTH];
+
+        for (uint32_t y = start_row; y < end_row; y++)
+        {
+            float  theta = ((y + 0.5f) / float(SKY_TABLE_HEIGHT)) * Pi_2;
+            float* cdf   = &m_sky_conditional_cdf[(SKY_TABLE_WIDTH + 1) * y];
+
+            for (int x = 0; x < SKY_TABLE_WIDTH; x += SKY_SIMD_WIDTH)
+            {
+                for (int i = 0; i < SKY_SIMD_WIDTH; i++)
+                    dirs[i] = map_theta_phi_to_direction(theta, ((x + i + 0.5f) / float(SKY_TABLE_WIDTH)) * Pi2);
+
+                sample_sky_simd(dirs, &m_sky_radiance[SKY_TABLE_WIDTH * y + x]);
+            }
+
+            cdf[0] = 0.0f;
+
+            for (int x = 0; x < SKY_TABLE_WIDTH; x++)
+            {
+                // Weighted by sin(theta) to account for the smaller solid angle of texels near the zenith.
+                float f = glm::dot(m_sky_radiance[SKY_TABLE_WIDTH * y + x], glm::vec3(0.2126f, 0.7152f, 0.0722f)) * sinf(theta);
+
+                m_sky_distribution[SKY_TABLE_WIDTH * y + x] = f;
+                cdf[x + 1]                                  = cdf[x] + f;
+            }
+        }
+    });
+
+    m_sky_marginal_cdf[0] = 0.0f;
+
+    for (int y = 0; y < SKY_TABLE_HEIGHT; y++)
+        m_sky_marginal_cdf[y + 1] = m_sky_marginal_cdf[y] + m_sky_conditional_cdf[(SKY_TABLE_WIDTH + 1) * y + SKY_TABLE_WIDTH];
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+glm::vec3 Skybox::sample_sky_direction(glm::vec2 u, float& pdf)
+{
+    float total = m_sky_marginal_cdf.empty() ? 0.0f : m_sky_marginal_cdf[SKY_TABLE_HEIGHT];
+
+    if (total <= 0.0f)
+    {
+        pdf = 0.0f;
+        return glm::vec3(0.0f, 1.0f, 0.0f);
+    }
+
+    // Pick a row from the marginal distribution, then a texel within it from that row's conditional distribution.
+    float v = u.y * total;
+    int   y = int(std::upper_bound(m_sky_marginal_cdf.begin(), m_sky_marginal_cdf.end(), v) - m_sky_marginal_cdf.begin()) - 1;
+    y       = glm::clamp(y, 0, SKY_TABLE_HEIGHT - 1);
+
+    const float* cdf = &m_sky_conditional_cdf[(SKY_TABLE_WIDTH + 1) * y];
+
+    float h = u.x * cdf[SKY_TABLE_WIDTH];
+    int   x = int(std::upper_bound(cdf, cdf + SKY_TABLE_WIDTH + 1, h) - cdf) - 1;
+    x       = glm::clamp(x, 0, SKY_TABLE_WIDTH - 1);
+
+    // Reuse the remainder of each random number to place the direction within the texel.
+    float dy = glm::clamp((v - m_sky_marginal_cdf[y]) / glm::max(m_sky_marginal_cdf[y + 1] - m_sky_marginal_cdf[y], 1e-20f), 0.0f, 0.9999f);
+    float dx = glm::clamp((h - cdf[x]) / glm::max(cdf[x + 1] - cdf[x], 1e-20f), 0.0f, 0.9999f);
+
+    float theta = ((y + dy) / float(SKY_TABLE_HEIGHT)) * Pi_2;
+    float phi   = ((x + dx) / float(SKY_TABLE_WIDTH)) * Pi2;
+
+    glm::vec3 dir = map_theta_phi_to_direction(theta, phi);
+
+    pdf = sky_pdf(dir);
+
+    return dir;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Solid angle density of sample_sky_direction().
+float Skybox::sky_pdf(glm::vec3 dir)
+{
+    float total = m_sky_marginal_cdf.empty() ? 0.0f : m_sky_marginal_cdf[SKY_TABLE_HEIGHT];
+
+    if (total <= 0.0f || dir.y <= 0.0f)
+        return 0.0f;
+
+    float sin_theta = sqrtf(glm::max(1.0f - dir.y * dir.y, 0.0f));
+
+    if (sin_theta < 1e-6f)
+        return 0.0f;
+
+    float theta = acosf(glm::min(dir.y, 1.0f));
+    float phi   = atan2f(dir.z, dir.x);
+
+    if (phi < 0.0f)
+        phi += Pi2;
+
+    int x = glm::min(int(phi / Pi2 * SKY_TABLE_WIDTH), SKY_TABLE_WIDTH - 1);
+    int y = glm::min(int(theta / Pi_2 * SKY_TABLE_HEIGHT), SKY_TABLE_HEIGHT - 1);
+
+    // Density over the unit square of the map, converted to solid angle.
+    float pdf_uv = m_sky_distribution[SKY_TABLE_WIDTH * y + x] / total * float(SKY_TABLE_WIDTH * SKY_TABLE_HEIGHT);
+
+    return pdf_uv / (Pi2 * Pi_2 * sin_theta);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Bilinearly filtered radiance from the sky table, for the bake. Directions below the horizon return the horizon.
+glm::vec3 Skybox::lookup_sky(glm::vec3 dir)
+{
+    if (m_sky_radiance.empty())
+        return glm::vec3(0.0f);
+
+    float theta = acosf(glm::clamp(dir.y, 0.0f, 1.0f));
+    float phi   = atan2f(dir.z, dir.x);
+
+    if (phi < 0.0f)
+        phi += Pi2;
+
+    float u = phi / Pi2 * SKY_TABLE_WIDTH - 0.5f;
+    float v = theta / Pi_2 * SKY_TABLE_HEIGHT - 0.5f;
+
+    float x_floor = floorf(u);
+    float y_floor = floorf(v);
+    float fx      = u - x_floor;
+    float fy      = v - y_floor;
+
+    // Longitude wraps around, latitude clamps at the zenith and the horizon.
+    int x0 = (int(x_floor) + SKY_TABLE_WIDTH) % SKY_TABLE_WIDTH;
+    int x1 = (x0 + 1) % SKY_TABLE_WIDTH;
+    int y0 = glm::clamp(int(y_floor), 0, SKY_TABLE_HEIGHT - 1);
+    int y1 = glm::clamp(int(y_floor) + 1, 0, SKY_TABLE_HEIGHT - 1);
+
+    glm::vec3 top    = glm::mix(m_sky_radiance[SKY_TABLE_WIDTH * y0 + x0], m_sky_radiance[SKY_TABLE_WIDTH * y0 + x1], fx);
+    glm::vec3 bottom = glm::mix(m_sky_radiance[SKY_TABLE_WIDTH * y1 + x0], m_sky_radiance[SKY_TABLE_WIDTH * y1 + x1], fx);
+
+    return glm::mix(top, bottom, fy);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -1,29 +1,57 @@
 #pragma once
 
 #include <ogl.h>
+#include <stdint.h>
+#include <functional>
 #include <vector>
 #include <memory>
 
 struct ArHosekSkyModelState;
 
+namespace dw
+{
+class ThreadPool;
+}
+
+// Single precision copy of the Hosek-Wilkie coefficients of one color channel.
+struct SkyModelChannel
+{
+    float config[9];
+    float radiance;
+};
+
 struct Skybox
 {
     ~Skybox();
-    bool      initialize(glm::vec3 sun_dir, glm::vec3 ground_albedo, float turbidity);
+    bool      initialize(glm::vec3 sun_dir, glm::vec3 ground_albedo, float turbidity, bool create_gpu_resources = true, dw::ThreadPool* thread_pool = nullptr);
     void      set_sun_dir(glm::vec3 sun_dir);
     void      render(std::unique_ptr<dw::Framebuffer> fbo, int w, int h, glm::mat4 proj, glm::mat4 view);
     glm::vec3 sample_sky(glm::vec3 dir);
+    void      sample_sky_simd(const glm::vec3* dirs, glm::vec3* radiance);
+    void      parallel_rows(uint32_t count, const std::function<void(uint32_t, uint32_t, uint32_t)>& function);
+    void      build_sky_table();
+    glm::vec3 lookup_sky(glm::vec3 dir);
+    glm::vec3 sample_sky_direction(glm::vec2 u, float& pdf);
+    float     sky_pdf(glm::vec3 dir);
+
+    glm::vec3                        m_sun_dir;
+    float                            m_turbidity = 0.0f;
+    glm::vec3                        m_ground_albedo;
+    float                            m_elevation = 0.0f;
+    ArHosekSkyModelState*            m_state_r   = nullptr;
+    ArHosekSkyModelState*            m_state_g   = nullptr;
+    ArHosekSkyModelState*            m_state_b   = nullptr;
+    SkyModelChannel                  m_channels[3];
+    dw::ThreadPool*                  m_thread_pool = nullptr;
+    std::unique_ptr<dw::TextureCube> m_skybox_texture;
+    std::unique_ptr<dw::Shader>      m_skybox_vs;
+    std::unique_ptr<dw::Shader>      m_skybox_fs;
+    std::unique_ptr<dw::Program>     m_skybox_program;
 
-    glm::vec3                           m_sun_dir;
-    float                               m_turbidity = 0.0f;
-    glm::vec3                           m_ground_albedo;
-    float                               m_elevation = 0.0f;
-    ArHosekSkyModelState*               m_state_r   = nullptr;
-    ArHosekSkyModelState*               m_state_g   = nullptr;
-    ArHosekSkyModelState*               m_state_b   = nullptr;
-    std::unique_ptr<dw::TextureCube>    m_skybox_texture;
-    std::unique_ptr<dw::Shader>         m_skybox_vs;
-    std::unique_ptr<dw::Shader>         m_skybox_fs;
-    std::unique_ptr<dw::Program>        m_skybox_program;
-    std::vector<std::vector<glm::vec4>> m_skybox_data;
+    // Latitude-longitude tables of the upper hemisphere used by the bake: radiance for lookup_sky() and a
+    // piecewise-constant luminance distribution for importance sampling. Read-only once set_sun_dir() returns.
+    std::vector<glm::vec3> m_sky_radiance;
+    std::vector<float>     m_sky_distribution;
+    std::vector<float>     m_sky_conditional_cdf;
+    std::vector<float>     m_sky_marginal_cdf;
 };
\ No newline at end of file
@@ -0,0 +1,127 @@
+#include "tiled_lightmap.h"
+#include "lightmap.h"
+#include "mapped_file.h"
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Tiled lightmaps easily grow beyond what a long can address.
+static bool seek(FILE* f, uint64_t offset)
+{
+#if defined(_WIN32)
+    return _fseeki64(f, int64_t(offset), SEEK_SET) == 0;
+#else
+    return fseeko(f, off_t(offset), SEEK_SET) == 0;
+#endif
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+TiledLightmapWriter::~TiledLightmapWriter()
+{
+    close();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool TiledLightmapWriter::open(const std::string& path, int size, int tile_size)
+{
+    close();
+
+    m_file = fopen(path.c_str(), "wb");
+
+    if (!m_file)
+        return false;
+
+    memset(&m_header, 0, sizeof(m_header));
+
+    m_header.magic         = TILED_LIGHTMAP_MAGIC;
+    m_header.version       = TILED_LIGHTMAP_VERSION;
+    m_header.size          = size;
+    m_header.tile_size     = tile_size;
+    m_header.tiles_per_row = (size + tile_size - 1) / tile_size;
+
+    return fwrite(&m_header, sizeof(m_header), 1, m_file) == 1;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool TiledLightmapWriter::write_tile(int tile_x, int tile_y, const glm::vec4* data, glm::ivec2 extent)
+{
+    const uint32_t tile_size  = m_header.tile_size;
+    const uint64_t tile_bytes = uint64_t(tile_size) * tile_size * sizeof(glm::vec4);
+
+    std::vector<glm::vec4> tile(tile_size * tile_size, glm::vec4(0.0f));
+
+    for (int y = 0; y < extent.y; y++)
+        std::copy(data + extent.x * y, data + extent.x * (y + 1), tile.begin() + tile_size * y);
+
+    if (!seek(m_file, sizeof(TiledLightmapHeader) + (uint64_t(m_header.tiles_per_row) * tile_y + tile_x) * tile_bytes))
+        return false;
+
+    return fwrite(tile.data(), sizeof(glm::vec4), tile.size(), m_file) == tile.size();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool TiledLightmapWriter::close()
+{
+    if (!m_file)
+        return true;
+
+    bool success = fclose(m_file) == 0;
+    m_file       = nullptr;
+
+    return success;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool convert_tiled_lightmap_to_hdr(const std::string& tiled_path, const std::string& hdr_path)
+{
+    MappedFile file;
+
+    if (!file.open(tiled_path) || file.m_size < sizeof(TiledLightmapHeader))
+        return false;
+
+    const TiledLightmapHeader* header = (const TiledLightmapHeader*)file.m_data;
+
+    if (header->magic != TILED_LIGHTMAP_MAGIC || header->version != TILED_LIGHTMAP_VERSION || header->tile_size == 0)
+        return false;
+
+    const int size          = int(header->size);
+    const int tile_size     = int(header->tile_size);
+    const int tiles_per_row = int(header->tiles_per_row);
+
+    if (file.m_size != sizeof(TiledLightmapHeader) + uint64_t(tiles_per_row) * tiles_per_row * tile_size * tile_size * sizeof(glm::vec4))
+        return false;
+
+    const glm::vec4* tiles = (const glm::vec4*)(file.m_data + sizeof(TiledLightmapHeader));
+
+    auto texel = [&](int x, int y) {
+        size_t tile = size_t(tiles_per_row) * (y / tile_size) + x / tile_size;
+        return tiles[tile * tile_size * tile_size + tile_size * (y % tile_size) + x % tile_size];
+    };
+
+    // Same dilation as dilate_lightmap(), with the neighbours fetched across tile boundaries.
+    return write_lightmap_hdr(hdr_path, size, [&](int y, glm::vec4* row) {
+        for (int x = 0; x < size; x++)
+        {
+            glm::vec4 c = texel(x, y);
+
+            for (int i = 0; i < 8 && c.a <= 0.0f; i++)
+            {
+                int nx = std::min(std::max(x + DilateOffsets[i].x, 0), size - 1);
+                int ny = std::min(std::max(y + DilateOffsets[i].y, 0), size - 1);
+
+                c = texel(nx, ny);
+            }
+
+            row[x] = c;
+        }
+    });
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
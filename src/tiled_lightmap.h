@@ -0,0 +1,43 @@
+#pragma once
+
+#include <ogl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+#define TILED_LIGHTMAP_MAGIC 0x4c544d4c // "LMTL"
+#define TILED_LIGHTMAP_VERSION 1
+
+// File layout: the header, followed by tiles_per_row^2 tiles of tile_size^2 RGBA32F texels, row-major both across
+// tiles and within a tile. Tiles along the right and bottom edge are padded to the full tile size, so every tile sits
+// at a fixed offset and tiles can be written in any order.
+struct TiledLightmapHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t tile_size;
+    uint32_t tiles_per_row;
+    uint32_t reserved[3];
+};
+
+// Writes the tiles of a lightmap that is too large to be held in memory as they are finished.
+struct TiledLightmapWriter
+{
+    TiledLightmapWriter() = default;
+    TiledLightmapWriter(const TiledLightmapWriter&) = delete;
+    TiledLightmapWriter& operator=(const TiledLightmapWriter&) = delete;
+    ~TiledLightmapWriter();
+    bool open(const std::string& path, int size, int tile_size);
+
+    // data holds extent.x * extent.y texels, the part of the tile that lies within the lightmap.
+    bool write_tile(int tile_x, int tile_y, const glm::vec4* data, glm::ivec2 extent);
+    bool close();
+
+    FILE*               m_file = nullptr;
+    TiledLightmapHeader m_header;
+};
+
+// Dilates a tiled lightmap and writes it out as a Radiance HDR file. The tiles are memory mapped and read one row at a
+// time, so this works for lightmaps of any size.
+bool convert_tiled_lightmap_to_hdr(const std::string& tiled_path, const std::string& hdr_path);
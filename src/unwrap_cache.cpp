@@ -0,0 +1,74 @@
+#include "unwrap_cache.h"
+#include "mapped_file.h"
+#include <stdio.h>
+#include <string.h>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool write_unwrap_cache(const std::string& path, uint64_t key, const std::vector<LightmapVertex>& vertices, const std::vector<uint32_t>& indices, const std::vector<LightmapSubMesh>& submeshes, const std::vector<uint32_t>& vertex_pages, uint32_t page_count)
+{
+    FILE* f = fopen(path.c_str(), "wb");
+
+    if (!f)
+        return false;
+
+    UnwrapCacheHeader header;
+
+    memset(&header, 0, sizeof(header));
+
+    header.magic         = UNWRAP_CACHE_MAGIC;
+    header.version       = UNWRAP_CACHE_VERSION;
+    header.key           = key;
+    header.vertex_count  = uint32_t(vertices.size());
+    header.index_count   = uint32_t(indices.size());
+    header.submesh_count = uint32_t(submeshes.size());
+    header.page_count    = page_count;
+
+    bool success = fwrite(&header, sizeof(header), 1, f) == 1;
+
+    success = success && fwrite(vertices.data(), sizeof(LightmapVertex), vertices.size(), f) == vertices.size();
+    success = success && fwrite(indices.data(), sizeof(uint32_t), indices.size(), f) == indices.size();
+    success = success && fwrite(submeshes.data(), sizeof(LightmapSubMesh), submeshes.size(), f) == submeshes.size();
+    success = success && fwrite(vertex_pages.data(), sizeof(uint32_t), vertex_pages.size(), f) == vertex_pages.size();
+
+    return fclose(f) == 0 && success;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool read_unwrap_cache(const std::string& path, uint64_t key, std::vector<LightmapVertex>& vertices, std::vector<uint32_t>& indices, std::vector<LightmapSubMesh>& submeshes, std::vector<uint32_t>& vertex_pages, uint32_t& page_count)
+{
+    MappedFile file;
+
+    if (!file.open(path) || file.m_size < sizeof(UnwrapCacheHeader))
+        return false;
+
+    const UnwrapCacheHeader* header = (const UnwrapCacheHeader*)file.m_data;
+
+    if (header->magic != UNWRAP_CACHE_MAGIC || header->version != UNWRAP_CACHE_VERSION || header->key != key)
+        return false;
+
+    const size_t vertex_bytes  = size_t(header->vertex_count) * sizeof(LightmapVertex);
+    const size_t index_bytes   = size_t(header->index_count) * sizeof(uint32_t);
+    const size_t submesh_bytes = size_t(header->submesh_count) * sizeof(LightmapSubMesh);
+    const size_t page_bytes    = size_t(header->vertex_count) * sizeof(uint32_t);
+
+    if (file.m_size != sizeof(UnwrapCacheHeader) + vertex_bytes + index_bytes + submesh_bytes + page_bytes)
+        return false;
+
+    const LightmapVertex*  vertex_data  = (const LightmapVertex*)(file.m_data + sizeof(UnwrapCacheHeader));
+    const uint32_t*        index_data   = (const uint32_t*)((const uint8_t*)vertex_data + vertex_bytes);
+    const LightmapSubMesh* submesh_data = (const LightmapSubMesh*)((const uint8_t*)index_data + index_bytes);
+    const uint32_t*        page_data    = (const uint32_t*)((const uint8_t*)submesh_data + submesh_bytes);
+
+    vertices.assign(vertex_data, vertex_data + header->vertex_count);
+    indices.assign(index_data, index_data + header->index_count);
+    submeshes.assign(submesh_data, submesh_data + header->submesh_count);
+    vertex_pages.assign(page_data, page_data + header->vertex_count);
+
+    page_count = header->page_count;
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "lightmap.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define UNWRAP_CACHE_MAGIC 0x43554d4c // "LMUC"
+#define UNWRAP_CACHE_VERSION 2
+
+// File layout: the header, followed by the vertices, indices and submeshes of the unwrapped mesh exactly as they are
+// laid out in memory, and the atlas page of every vertex.
+struct UnwrapCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint32_t vertex_count;
+    uint32_t index_count;
+    uint32_t submesh_count;
+    uint32_t page_count;
+};
+
+bool write_unwrap_cache(const std::string& path, uint64_t key, const std::vector<LightmapVertex>& vertices, const std::vector<uint32_t>& indices, const std::vector<LightmapSubMesh>& submeshes, const std::vector<uint32_t>& vertex_pages, uint32_t page_count);
+
+// Memory maps the cache and fills the buffers with one bulk copy each. Fails if the file is missing, has another
+// version or was unwrapped from a different key.
+bool read_unwrap_cache(const std::string& path, uint64_t key, std::vector<LightmapVertex>& vertices, std::vector<uint32_t>& indices, std::vector<LightmapSubMesh>& submeshes, std::vector<uint32_t>& vertex_pages, uint32_t& page_count);